@@ -79,6 +79,14 @@ if(USE_OPENCV)
   add_definitions(-DUSE_OPENCV)
 endif()
 
+# ---[ libjpeg
+if(USE_LIBJPEG)
+  find_package(JPEG REQUIRED)
+  include_directories(SYSTEM ${JPEG_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS ${JPEG_LIBRARIES})
+  add_definitions(-DUSE_LIBJPEG)
+endif()
+
 # ---[ BLAS
 if(NOT APPLE)
   set(BLAS "Atlas" CACHE STRING "Selected BLAS library")
@@ -92,6 +100,7 @@ if(NOT APPLE)
     find_package(OpenBLAS REQUIRED)
     include_directories(SYSTEM ${OpenBLAS_INCLUDE_DIR})
     list(APPEND Caffe_LINKER_LIBS ${OpenBLAS_LIB})
+    add_definitions(-DUSE_OPENBLAS)
   elseif(BLAS STREQUAL "MKL" OR BLAS STREQUAL "mkl")
     find_package(MKL REQUIRED)
     include_directories(SYSTEM ${MKL_INCLUDE_DIR})
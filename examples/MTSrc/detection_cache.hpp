@@ -0,0 +1,139 @@
+// Bounded LRU cache of MTCNN results for byte-identical images, keyed by a
+// hash of the encoded file plus the detector parameters.
+#ifndef DETECTION_CACHE_HPP_
+#define DETECTION_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/thread.hpp"
+
+#include "mtcnn.hpp"
+
+// 64-bit MurmurHash2 (MurmurHash64A): eight bytes per step, good enough
+// mixing for a cache key and far cheaper than the detection it saves.
+inline uint64_t HashBytes(const void* key, size_t len, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = seed ^ (len * m);
+  const unsigned char* data = static_cast<const unsigned char*>(key);
+  const unsigned char* end = data + (len / 8) * 8;
+  for (; data != end; data += 8) {
+    uint64_t k;
+    memcpy(&k, data, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  switch (len & 7) {
+  case 7: h ^= uint64_t(data[6]) << 48;
+  case 6: h ^= uint64_t(data[5]) << 40;
+  case 5: h ^= uint64_t(data[4]) << 32;
+  case 4: h ^= uint64_t(data[3]) << 24;
+  case 3: h ^= uint64_t(data[2]) << 16;
+  case 2: h ^= uint64_t(data[1]) << 8;
+  case 1: h ^= uint64_t(data[0]);
+          h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+struct CachedDetection {
+  std::vector<FaceRect> rects;
+  std::vector<FacePts> pts;
+};
+
+class DetectionCache {
+ public:
+  explicit DetectionCache(size_t capacity)
+      : capacity_(capacity), hits_(0), misses_(0) {}
+
+  // Seed for Key(): everything besides the image that changes the result.
+  static uint64_t ParamsSeed(int min_size, double factor,
+      const double* threshold, int decode_denom) {
+    double params[6] = {static_cast<double>(min_size), factor,
+        threshold[0], threshold[1], threshold[2],
+        static_cast<double>(decode_denom)};
+    return HashBytes(params, sizeof(params), 0);
+  }
+  static uint64_t Key(const std::string& encoded, uint64_t params_seed) {
+    return HashBytes(encoded.data(), encoded.size(), params_seed);
+  }
+
+  // Copies the cached result for key into value and marks it most recently
+  // used. Counts a hit or a miss.
+  bool Lookup(uint64_t key, CachedDetection* value) {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::map<uint64_t, Iterator>::iterator it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return false;
+    }
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *value = it->second->second;
+    return true;
+  }
+
+  void Insert(uint64_t key, const CachedDetection& value) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (capacity_ == 0) {
+      return;
+    }
+    std::map<uint64_t, Iterator>::iterator it = index_.find(key);
+    if (it != index_.end()) {
+      // Identical images raced through the detector; keep the first.
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+    if (index_.size() >= capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.push_front(std::make_pair(key, value));
+    index_[key] = entries_.begin();
+  }
+
+  size_t size() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return index_.size();
+  }
+  uint64_t hits() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return hits_;
+  }
+  uint64_t misses() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return misses_;
+  }
+  double hit_rate() {
+    boost::mutex::scoped_lock lock(mutex_);
+    const uint64_t lookups = hits_ + misses_;
+    return lookups ? static_cast<double>(hits_) / lookups : 0;
+  }
+
+ private:
+  typedef std::list<std::pair<uint64_t, CachedDetection> > List;
+  typedef List::iterator Iterator;
+
+  size_t capacity_;
+  boost::mutex mutex_;
+  // Most recently used first.
+  List entries_;
+  std::map<uint64_t, Iterator> index_;
+  uint64_t hits_;
+  uint64_t misses_;
+};
+
+#endif  // DETECTION_CACHE_HPP_
@@ -0,0 +1,632 @@
+// Runs the MTCNN detector over a corpus of images and streams the results,
+// in input order, as JSON lines or as compact binary records.
+// Usage:
+//    mtcnn_detect [FLAGS] MODEL_DIR
+//
+// MODEL_DIR holds det{1,2,3}.caffemodel, det1.prototxt and
+// det{2,3}_input.prototxt. Images come from --list (one path per line) or
+// from every image file found under --dir.
+//
+// When built with USE_LIBJPEG, JPEGs are decoded at 1/2, 1/4 or 1/8 size
+// when --min_size allows it (see --decode_face_size); boxes and landmarks
+// are always reported in full resolution coordinates.
+//
+// --cache_size keeps the results of that many distinct images; byte-identical
+// files (re-posts, copies) are then answered without decoding or detection.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef USE_LIBJPEG
+// jpeglib.h needs FILE and size_t declared first.
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif  // USE_LIBJPEG
+
+#include "boost/algorithm/string.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/thread.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "detection_cache.hpp"
+#include "mtcnn.hpp"
+
+using caffe::BlockingQueue;
+using caffe::CPUTimer;
+using std::string;
+using std::vector;
+
+#ifndef GFLAGS_GFLAGS_H_
+namespace gflags = google;
+#endif
+
+DEFINE_string(list, "",
+    "Text file with one image path per line.");
+DEFINE_string(dir, "",
+    "Directory searched recursively for .jpg/.jpeg/.png/.bmp files.");
+DEFINE_string(output, "-",
+    "Output file, or - for stdout.");
+DEFINE_string(format, "jsonl",
+    "Output format: jsonl or binary.");
+DEFINE_int32(readers, 2,
+    "Number of threads decoding images.");
+DEFINE_int32(workers, 0,
+    "Number of detector contexts; 0 uses one per hardware thread.");
+DEFINE_int32(queue_depth, 0,
+    "Images in flight between the readers, workers and writer; "
+    "0 uses 4 per worker.");
+DEFINE_int32(min_size, 40,
+    "Smallest face size to detect, in pixels.");
+DEFINE_double(factor, 0.709,
+    "Scale factor between pyramid levels.");
+DEFINE_string(thresholds, "0.6,0.7,0.7",
+    "Comma separated score thresholds for PNet, RNet and ONet.");
+DEFINE_bool(scaled_decode, true,
+    "Decode JPEGs at reduced size when --min_size allows it. "
+    "Needs a build with USE_LIBJPEG.");
+DEFINE_int32(decode_face_size, 48,
+    "Smallest size, in pixels of the reduced image, that a --min_size face "
+    "may shrink to under scaled decoding. 48 keeps ONet crops at native "
+    "resolution; 12 is the least PNet can work with.");
+DEFINE_int32(cache_size, 0,
+    "Number of results kept for byte-identical images; 0 disables the "
+    "cache.");
+
+namespace {
+
+struct DetectResult {
+  bool ok;
+  vector<FaceRect> rects;
+  vector<FacePts> pts;
+  Datum* slot;
+};
+
+bool IsImageFile(const boost::filesystem::path& path) {
+  string ext = boost::algorithm::to_lower_copy(path.extension().string());
+  return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp";
+}
+
+void CollectImages(vector<string>* images) {
+  if (!FLAGS_list.empty()) {
+    std::ifstream infile(FLAGS_list.c_str());
+    CHECK(infile.good()) << "Failed to open list " << FLAGS_list;
+    string line;
+    while (std::getline(infile, line)) {
+      boost::algorithm::trim(line);
+      if (!line.empty()) {
+        images->push_back(line);
+      }
+    }
+  }
+  if (!FLAGS_dir.empty()) {
+    CHECK(boost::filesystem::is_directory(FLAGS_dir))
+        << FLAGS_dir << " is not a directory";
+    vector<string> found;
+    boost::filesystem::recursive_directory_iterator it(FLAGS_dir), end;
+    for (; it != end; ++it) {
+      if (boost::filesystem::is_regular_file(it->status()) &&
+          IsImageFile(it->path())) {
+        found.push_back(it->path().string());
+      }
+    }
+    // Directory order is filesystem dependent; sort so runs are repeatable.
+    std::sort(found.begin(), found.end());
+    images->insert(images->end(), found.begin(), found.end());
+  }
+}
+
+bool ReadFile(const string& filename, string* buffer) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  const std::streamoff size = file.tellg();
+  if (size <= 0) {
+    return false;
+  }
+  buffer->resize(size);
+  file.seekg(0, std::ios::beg);
+  file.read(&(*buffer)[0], size);
+  return file.good();
+}
+
+// Stores a decoded BGR image in datum. float_data carries the row and column
+// factors that map the stored image back to the original resolution.
+void SetDatumImage(const cv::Mat& img, Datum* datum) {
+  CHECK(img.isContinuous());
+  datum->set_channels(img.channels());
+  datum->set_height(img.rows);
+  datum->set_width(img.cols);
+  datum->mutable_data()->assign(reinterpret_cast<char*>(img.data),
+      img.total() * img.elemSize());
+  datum->clear_float_data();
+  datum->add_float_data(1);
+  datum->add_float_data(1);
+}
+
+#ifdef USE_LIBJPEG
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+// Corrupt-data warnings are expected in a large corpus; stay quiet.
+void JpegOutputMessage(j_common_ptr cinfo) {}
+
+// Decodes a JPEG at 1/denom of its size (denom is 1, 2, 4 or 8) directly into
+// datum as BGR. libjpeg scales in the DCT domain, so the pixels the first
+// pyramid level would throw away are never produced. Returns false for
+// anything libjpeg cannot hand back as 3 channels, leaving the caller to fall
+// back to OpenCV.
+bool DecodeJpegScaled(const string& buffer, int denom, Datum* datum) {
+  if (buffer.size() < 2 || static_cast<unsigned char>(buffer[0]) != 0xFF ||
+      static_cast<unsigned char>(buffer[1]) != 0xD8) {
+    return false;
+  }
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager jerr;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = JpegErrorExit;
+  jerr.pub.output_message = JpegOutputMessage;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo,
+      reinterpret_cast<unsigned char*>(const_cast<char*>(buffer.data())),
+      buffer.size());
+  jpeg_read_header(&cinfo, TRUE);
+  if (cinfo.jpeg_color_space == JCS_CMYK ||
+      cinfo.jpeg_color_space == JCS_YCCK) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+#ifdef JCS_EXTENSIONS
+  cinfo.out_color_space = JCS_EXT_BGR;
+#else
+  cinfo.out_color_space = JCS_RGB;
+#endif
+  jpeg_start_decompress(&cinfo);
+  const int height = cinfo.output_height;
+  const int width = cinfo.output_width;
+  const int stride = width * 3;
+  string* data = datum->mutable_data();
+  data->resize(static_cast<size_t>(height) * stride);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = reinterpret_cast<JSAMPROW>(
+        &(*data)[static_cast<size_t>(cinfo.output_scanline) * stride]);
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+#ifndef JCS_EXTENSIONS
+  for (size_t i = 0; i < data->size(); i += 3) {
+    std::swap((*data)[i], (*data)[i + 2]);
+  }
+#endif
+  datum->set_channels(3);
+  datum->set_height(height);
+  datum->set_width(width);
+  datum->clear_float_data();
+  datum->add_float_data(static_cast<float>(cinfo.image_height) / height);
+  datum->add_float_data(static_cast<float>(cinfo.image_width) / width);
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+#endif  // USE_LIBJPEG
+
+// Largest libjpeg scale denominator that keeps a --min_size face at least
+// --decode_face_size pixels across.
+int DecodeDenominator() {
+  for (int denom = 8; denom > 1; denom /= 2) {
+    if (FLAGS_min_size >= denom * FLAGS_decode_face_size) {
+      return denom;
+    }
+  }
+  return 1;
+}
+
+string JsonEscape(const string& s) {
+  std::ostringstream out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    switch (c) {
+    case '"':  out << "\\\""; break;
+    case '\\': out << "\\\\"; break;
+    case '\n': out << "\\n"; break;
+    case '\r': out << "\\r"; break;
+    case '\t': out << "\\t"; break;
+    default:
+      if (c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out << buf;
+      } else {
+        out << c;
+      }
+    }
+  }
+  return out.str();
+}
+
+// Writes results in input order. Workers finish out of order, so results are
+// parked until every earlier index has been written. A result keeps its
+// Datum slot until it is written, which bounds the reorder buffer by the
+// number of slots.
+class ResultWriter {
+ public:
+  ResultWriter(const vector<string>& images, FILE* out, bool binary,
+      BlockingQueue<Datum*>* free)
+      : images_(images), out_(out), binary_(binary), free_(free),
+        next_(0), num_faces_(0), num_errors_(0) {}
+
+  void Push(int index, const DetectResult& result) {
+    boost::mutex::scoped_lock lock(mutex_);
+    pending_[index] = result;
+    std::map<int, DetectResult>::iterator it;
+    while ((it = pending_.find(next_)) != pending_.end()) {
+      Write(next_, it->second);
+      free_->push(it->second.slot);
+      pending_.erase(it);
+      ++next_;
+      if (next_ % 1000 == 0) {
+        LOG(INFO) << "Processed " << next_ << " of " << images_.size()
+                  << " images.";
+      }
+    }
+  }
+
+  int num_faces() const { return num_faces_; }
+  int num_errors() const { return num_errors_; }
+
+ private:
+  void Write(int index, const DetectResult& result) {
+    if (!result.ok) {
+      ++num_errors_;
+    } else {
+      num_faces_ += result.rects.size();
+    }
+    if (binary_) {
+      WriteBinary(index, result);
+    } else {
+      WriteJson(index, result);
+    }
+  }
+
+  // Detector coordinates are transposed (x is the row), so boxes and
+  // landmarks are swapped back to image x/y here.
+  void WriteJson(int index, const DetectResult& result) {
+    std::ostringstream line;
+    line << "{\"index\":" << index
+         << ",\"image\":\"" << JsonEscape(images_[index]) << "\"";
+    if (!result.ok) {
+      line << ",\"error\":\"decode failed\"}\n";
+    } else {
+      line << ",\"faces\":[";
+      for (size_t i = 0; i < result.rects.size(); ++i) {
+        const FaceRect& r = result.rects[i];
+        const FacePts& p = result.pts[i];
+        line << (i ? "," : "") << "{\"box\":[" << r.y1 << "," << r.x1 << ","
+             << r.y2 << "," << r.x2 << "],\"score\":" << r.score
+             << ",\"landmarks\":[";
+        for (int j = 0; j < 5; ++j) {
+          line << (j ? "," : "") << "[" << p.y[j] << "," << p.x[j] << "]";
+        }
+        line << "]}";
+      }
+      line << "]}\n";
+    }
+    const string s = line.str();
+    fwrite(s.data(), 1, s.size(), out_);
+  }
+
+  // Record: int32 index, int32 num_faces (-1 if the image failed to
+  // decode), then per face float box[4] (x1,y1,x2,y2), float score and
+  // float landmarks[10] (x0,y0,...,x4,y4).
+  void WriteBinary(int index, const DetectResult& result) {
+    int32_t header[2];
+    header[0] = index;
+    header[1] = result.ok ? static_cast<int32_t>(result.rects.size()) : -1;
+    fwrite(header, sizeof(header), 1, out_);
+    for (size_t i = 0; i < result.rects.size(); ++i) {
+      const FaceRect& r = result.rects[i];
+      const FacePts& p = result.pts[i];
+      float record[15] = {r.y1, r.x1, r.y2, r.x2, r.score};
+      for (int j = 0; j < 5; ++j) {
+        record[5 + 2 * j] = p.y[j];
+        record[6 + 2 * j] = p.x[j];
+      }
+      fwrite(record, sizeof(record), 1, out_);
+    }
+  }
+
+  const vector<string>& images_;
+  FILE* out_;
+  bool binary_;
+  BlockingQueue<Datum*>* free_;
+  boost::mutex mutex_;
+  std::map<int, DetectResult> pending_;
+  int next_;
+  int num_faces_;
+  int num_errors_;
+};
+
+// Shared state of the pipeline. Datum slots circulate free_ -> readers ->
+// full_ -> workers -> writer -> free_, the same bounded prefetch scheme the
+// data layers use, so memory stays flat however large the corpus is.
+class BatchDetector {
+ public:
+  BatchDetector(const string& model_dir, const vector<string>& images,
+      ResultWriter* writer, BlockingQueue<Datum*>* free,
+      BlockingQueue<Datum*>* full, int num_readers, int num_workers,
+      DetectionCache* cache)
+      : prototype_(model_dir), images_(images), writer_(writer),
+        free_(free), full_(full), num_readers_(num_readers),
+        num_workers_(num_workers), cache_(cache), next_read_(0),
+        readers_done_(0),
+        decode_denom_(FLAGS_scaled_decode ? DecodeDenominator() : 1) {
+    vector<string> fields;
+    boost::split(fields, FLAGS_thresholds, boost::is_any_of(","));
+    CHECK_EQ(fields.size(), 3) << "--thresholds needs three values";
+    for (int i = 0; i < 3; ++i) {
+      threshold_[i] = atof(fields[i].c_str());
+    }
+    params_seed_ = DetectionCache::ParamsSeed(FLAGS_min_size, FLAGS_factor,
+        threshold_, decode_denom_);
+  }
+
+  // Decodes images into free slots. The slot is taken before the index is
+  // claimed so that indices enter full_ in roughly increasing order and the
+  // writer never waits on an image that has no slot.
+  void ReadLoop() {
+    const int num_images = images_.size();
+    while (true) {
+      Datum* datum = free_->pop();
+      int index;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        index = next_read_++;
+      }
+      if (index >= num_images) {
+        free_->push(datum);
+        break;
+      }
+      datum->set_label(index);
+      if (!buffer_.get()) {
+        buffer_.reset(new string());
+      }
+      string& buffer = *buffer_;
+      const bool read = ReadFile(images_[index], &buffer);
+      uint64_t key = 0;
+      if (read && cache_) {
+        // A hit skips decoding and detection altogether.
+        key = DetectionCache::Key(buffer, params_seed_);
+        CachedDetection cached;
+        if (cache_->Lookup(key, &cached)) {
+          DetectResult result;
+          result.ok = true;
+          result.rects.swap(cached.rects);
+          result.pts.swap(cached.pts);
+          result.slot = datum;
+          writer_->Push(index, result);
+          continue;
+        }
+      }
+      if (!read || !Decode(buffer, datum)) {
+        LOG(WARNING) << "Could not decode " << images_[index];
+        datum->set_channels(0);
+        datum->set_height(0);
+        datum->set_width(0);
+        datum->clear_data();
+      } else if (cache_) {
+        boost::mutex::scoped_lock lock(mutex_);
+        pending_keys_[index] = key;
+      }
+      full_->push(datum);
+    }
+    // The last reader out tells every worker to stop.
+    boost::mutex::scoped_lock lock(mutex_);
+    if (++readers_done_ == num_readers_) {
+      for (int i = 0; i < num_workers_; ++i) {
+        full_->push(NULL);
+      }
+    }
+  }
+
+  bool Decode(const string& buffer, Datum* datum) {
+#ifdef USE_LIBJPEG
+    if (decode_denom_ > 1 && DecodeJpegScaled(buffer, decode_denom_, datum)) {
+      return true;
+    }
+#endif
+    cv::Mat img = cv::imdecode(cv::Mat(1, buffer.size(), CV_8UC1,
+        const_cast<char*>(buffer.data())), cv::IMREAD_COLOR);
+    if (img.empty()) {
+      return false;
+    }
+    SetDatumImage(img, datum);
+    return true;
+  }
+
+  // Each worker owns its own detector: nets keep per-call state, and the
+  // Caffe mode is thread local, so the MTCNN is built on the worker thread.
+  // The detectors share the prototype's weights.
+  void DetectLoop() {
+    MTCNN detector(prototype_);
+    Datum* datum;
+    while ((datum = full_->pop()) != NULL) {
+      DetectResult result;
+      result.slot = datum;
+      result.ok = datum->height() > 0;
+      if (result.ok) {
+        cv::Mat img(datum->height(), datum->width(), CV_8UC3,
+            const_cast<char*>(datum->data().data()));
+        // Detector coordinates are transposed: x is the row.
+        const float row_scale = datum->float_data(0);
+        const float col_scale = datum->float_data(1);
+        const int min_size = static_cast<int>(
+            FLAGS_min_size / std::max(row_scale, col_scale));
+        detector.Detect(img, result.rects, result.pts, min_size,
+            threshold_, FLAGS_factor);
+        if (row_scale != 1 || col_scale != 1) {
+          for (size_t i = 0; i < result.rects.size(); ++i) {
+            FaceRect& r = result.rects[i];
+            r.x1 *= row_scale;
+            r.x2 *= row_scale;
+            r.y1 *= col_scale;
+            r.y2 *= col_scale;
+            for (int j = 0; j < 5; ++j) {
+              result.pts[i].x[j] *= row_scale;
+              result.pts[i].y[j] *= col_scale;
+            }
+          }
+        }
+        if (cache_) {
+          CacheResult(datum->label(), result);
+        }
+      }
+      writer_->Push(datum->label(), result);
+    }
+  }
+
+ private:
+  void CacheResult(int index, const DetectResult& result) {
+    uint64_t key;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      std::map<int, uint64_t>::iterator it = pending_keys_.find(index);
+      CHECK(it != pending_keys_.end());
+      key = it->second;
+      pending_keys_.erase(it);
+    }
+    CachedDetection cached;
+    cached.rects = result.rects;
+    cached.pts = result.pts;
+    cache_->Insert(key, cached);
+  }
+
+  const MTCNN prototype_;
+  const vector<string>& images_;
+  ResultWriter* writer_;
+  BlockingQueue<Datum*>* free_;
+  BlockingQueue<Datum*>* full_;
+  int num_readers_;
+  int num_workers_;
+  DetectionCache* cache_;
+  boost::mutex mutex_;
+  int next_read_;
+  int readers_done_;
+  double threshold_[3];
+  int decode_denom_;
+  uint64_t params_seed_;
+  // Cache keys of the images the workers have yet to finish, by index.
+  std::map<int, uint64_t> pending_keys_;
+  // Per-reader scratch for the encoded file.
+  boost::thread_specific_ptr<string> buffer_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Detect faces in a set of images.\n"
+        "Usage:\n"
+        "    mtcnn_detect [FLAGS] MODEL_DIR\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2 || (FLAGS_list.empty() && FLAGS_dir.empty())) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "mtcnn_detect");
+    return 1;
+  }
+  CHECK(FLAGS_format == "jsonl" || FLAGS_format == "binary")
+      << "Unknown --format " << FLAGS_format;
+
+  vector<string> images;
+  CollectImages(&images);
+  LOG(INFO) << "A total of " << images.size() << " images.";
+  if (images.empty()) {
+    return 0;
+  }
+
+  const int num_workers = FLAGS_workers > 0 ? FLAGS_workers :
+      std::max(1u, boost::thread::hardware_concurrency());
+  const int num_readers = std::max(1, FLAGS_readers);
+  const int queue_depth = FLAGS_queue_depth > 0 ? FLAGS_queue_depth :
+      4 * num_workers;
+
+  const bool binary = FLAGS_format == "binary";
+  FILE* out = stdout;
+  if (FLAGS_output != "-") {
+    out = fopen(FLAGS_output.c_str(), binary ? "wb" : "w");
+    CHECK(out) << "Failed to open " << FLAGS_output;
+  }
+
+  vector<Datum> slots(queue_depth);
+  BlockingQueue<Datum*> free;
+  BlockingQueue<Datum*> full;
+  for (int i = 0; i < queue_depth; ++i) {
+    free.push(&slots[i]);
+  }
+  ResultWriter writer(images, out, binary, &free);
+  boost::shared_ptr<DetectionCache> cache;
+  if (FLAGS_cache_size > 0) {
+    cache.reset(new DetectionCache(FLAGS_cache_size));
+  }
+  BatchDetector detector(argv[1], images, &writer, &free, &full,
+      num_readers, num_workers, cache.get());
+
+  LOG(INFO) << "Running " << num_readers << " readers and " << num_workers
+            << " workers with " << queue_depth << " images in flight.";
+  CPUTimer timer;
+  timer.Start();
+  boost::thread_group threads;
+  for (int i = 0; i < num_readers; ++i) {
+    threads.create_thread(boost::bind(&BatchDetector::ReadLoop, &detector));
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    threads.create_thread(boost::bind(&BatchDetector::DetectLoop, &detector));
+  }
+  threads.join_all();
+  timer.Stop();
+
+  if (out != stdout) {
+    fclose(out);
+  } else {
+    fflush(out);
+  }
+  const double seconds = timer.Seconds();
+  LOG(INFO) << "Detected " << writer.num_faces() << " faces in "
+            << images.size() << " images (" << writer.num_errors()
+            << " failed to decode) in " << seconds << " s, "
+            << images.size() / seconds << " images/s.";
+  if (cache) {
+    LOG(INFO) << "Cache: " << cache->hits() << " hits, " << cache->misses()
+              << " misses (hit rate " << cache->hit_rate() << "), "
+              << cache->size() << " entries.";
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef CAFFE_ACTIVATION_ARENA_HPP_
+#define CAFFE_ACTIVATION_ARENA_HPP_
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A single host buffer that backs the intermediate activations of one
+ *        or more Nets that never run at the same time.
+ *
+ * A Net with an arena (see Net::set_activation_arena) binds its intermediate
+ * top blobs into the arena at the start of each CPU forward pass, so Nets
+ * sharing an arena need only as much activation memory as the largest of
+ * them. The contents of the arena are only valid until the next pass of any
+ * Net that shares it.
+ *
+ * Capacity grows on demand. So that one unusually large pass does not pin
+ * memory forever, every trim_window() reservations the arena shrinks to the
+ * largest reservation seen in that window if its capacity exceeds it by more
+ * than trim_slack() times.
+ *
+ * The arena is not thread safe; use one per thread (e.g. per detector).
+ */
+class ActivationArena {
+ public:
+  ActivationArena();
+  ~ActivationArena();
+
+  /**
+   * @brief Returns a buffer of at least size bytes. The buffer, and any
+   *        pointer into it, is invalidated by the next call to Reserve.
+   */
+  void* Reserve(size_t size);
+  /// @brief Frees the buffer; the next Reserve allocates again.
+  void Release();
+
+  size_t capacity() const { return capacity_; }
+  /// @brief The largest reservation since the arena was created.
+  size_t peak() const { return peak_; }
+
+  void set_trim_policy(int window, float slack);
+  int trim_window() const { return trim_window_; }
+  float trim_slack() const { return trim_slack_; }
+
+  /// @brief Required alignment, in bytes, of each blob placed in the arena.
+  static const size_t kAlignment = 64;
+  static size_t Align(size_t size) {
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+ private:
+  void Resize(size_t size);
+
+  void* ptr_;
+  size_t capacity_;
+  size_t peak_;
+  size_t window_peak_;
+  int window_count_;
+  int trim_window_;
+  float trim_slack_;
+
+  DISABLE_COPY_AND_ASSIGN(ActivationArena);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_ACTIVATION_ARENA_HPP_
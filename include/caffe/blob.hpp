@@ -13,6 +13,9 @@ const int kMaxBlobAxes = 32;
 
 namespace caffe {
 
+/// @brief The channels per block of the blocked NCHW8c layout.
+const int kChannelBlock = 8;
+
 /**
  * @brief A wrapper around SyncedMemory holders serving as the basic
  *        computational unit through which Layer%s, Net%s, and Solver%s
@@ -24,7 +27,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), data_offset_(0),
+         diff_offset_(0), blocked_channels_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -42,7 +46,8 @@ class Blob {
    * of memory, and to adjust the dimensions of a top blob during Layer::Reshape
    * or Layer::Forward. When changing the size of blob, memory will only be
    * reallocated if sufficient memory does not already exist, and excess memory
-   * will never be freed.
+   * will never be freed. A view (see ShareView) that is reshaped beyond the
+   * storage it can see gets memory of its own and stops being a view.
    *
    * Note that reshaping an input blob and immediately calling Net::Backward is
    * an error; either Net::Forward or Net::Reshape need to be called to
@@ -218,6 +223,8 @@ class Blob {
 
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
+  /// @brief set_cpu_data for data that owner keeps valid (see SyncedMemory).
+  void set_cpu_data(Dtype* data, const shared_ptr<void>& owner);
   const int* gpu_shape() const;
   const Dtype* gpu_data() const;
   const Dtype* cpu_diff() const;
@@ -262,9 +269,45 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make this Blob, at its current shape, a view of other's data and
+   *        diff starting offset elements into other.
+   *
+   * No memory is copied: the view and other share SyncedMemory, so head
+   * state and synchronization are common to both. Writing through either is
+   * visible in the other. Views of views compose, and ShareData/ShareDiff
+   * of a view share the same range. The typical use is a zero-copy range of
+   * a batch along axis 0, e.g. offset = other.offset(n) with num() items.
+   */
+  void ShareView(const Blob& other, int offset);
+  /**
+   * @brief Give this Blob fresh storage of its own at its current shape, e.g.
+   *        for a layer top that was a view and must now be written to.
+   */
+  void Detach();
+  /// @brief Offset, in elements, of this Blob's data in data().
+  inline int data_offset() const { return data_offset_; }
+  /// @brief Offset, in elements, of this Blob's diff in diff().
+  inline int diff_offset() const { return diff_offset_; }
 
   bool ShapeEquals(const BlobProto& other);
 
+  /**
+   * @brief The channels of a blob in the blocked NCHW8c layout, or 0 for the
+   *        plain layout.
+   *
+   * A blocked blob is shaped (N, ceil(C / kChannelBlock), H, W,
+   * kChannelBlock): channel c of a pixel is lane c % kChannelBlock of block
+   * c / kChannelBlock, so one vector holds neighbouring channels of a pixel,
+   * and the lanes past C are padding. Layers that produce blocked tops set
+   * this in Reshape, ReshapeLike copies it, and Layer::SetUp rejects blocked
+   * bottoms for layers that do not AllowBlockedBottoms.
+   */
+  inline int blocked_channels() const { return blocked_channels_; }
+  inline void set_blocked_channels(int channels) {
+    blocked_channels_ = channels;
+  }
+
  protected:
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
@@ -272,6 +315,10 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  /// Start of this Blob within data_ and diff_, non-zero only for views.
+  int data_offset_;
+  int diff_offset_;
+  int blocked_channels_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -97,6 +97,8 @@ using std::vector;
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class ThreadPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -163,6 +165,15 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Sets the number of threads, the caller included, that CPU layers split
+  // their work over (see ParallelFor in util/thread_pool.hpp). Unlike the
+  // settings above this is process wide, and it must not be changed while
+  // a net is running. With more than one thread BLAS is limited to one, so
+  // that the two do not oversubscribe the cores. The default is 1.
+  static void set_num_threads(const int num_threads);
+  static int num_threads();
+  // The process-wide pool, or NULL when running single threaded.
+  static ThreadPool* thread_pool();
 
  protected:
 #ifndef CPU_ONLY
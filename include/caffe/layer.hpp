@@ -38,7 +38,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param), is_shared_(false) {
+    : layer_param_(param), forward_only_(false), is_shared_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -282,6 +282,15 @@ class Layer {
    */
   virtual inline bool AutoTopBlobs() const { return false; }
 
+  /**
+   * @brief Return whether the layer takes bottom blobs in the blocked NCHW8c
+   *        layout (see Blob::blocked_channels).
+   *
+   * Layers that return true produce their tops in the layout of their
+   * bottoms, at least on the CPU forward path.
+   */
+  virtual inline bool AllowBlockedBottoms() const { return false; }
+
   /**
    * @brief Return whether to allow force_backward for a given bottom blob
    *        index.
@@ -316,6 +325,15 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /// @brief Returns whether Backward will never be called.
+  inline bool forward_only() const { return forward_only_; }
+  /**
+   * @brief Sets whether Backward will never be called, so that Forward may
+   *        skip keeping what only Backward needs. Net sets it for the layers
+   *        of TEST nets that do not need backward.
+   */
+  inline void set_forward_only(const bool value) { forward_only_ = value; }
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -326,6 +344,8 @@ class Layer {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** Whether Backward will never be called. */
+  bool forward_only_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
@@ -366,7 +386,8 @@ class Layer {
   /**
    * Called by the parent Layer's SetUp to check that the number of bottom
    * and top Blobs provided as input match the expected numbers specified by
-   * the {ExactNum,Min,Max}{Bottom,Top}Blobs() functions.
+   * the {ExactNum,Min,Max}{Bottom,Top}Blobs() functions, and that blocked
+   * bottoms only go to layers that AllowBlockedBottoms().
    */
   virtual void CheckBlobCounts(const vector<Blob<Dtype>*>& bottom,
                                const vector<Blob<Dtype>*>& top) {
@@ -405,6 +426,11 @@ class Layer {
           << type() << " Layer produces one top blob as output for each "
           << "bottom blob input.";
     }
+    for (int i = 0; i < bottom.size(); ++i) {
+      CHECK(AllowBlockedBottoms() || bottom[i]->blocked_channels() == 0)
+          << type() << " Layer does not take bottom blobs in the blocked "
+          << "NCHW8c layout.";
+    }
   }
 
   /**
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/packed_weights.hpp"
 
 namespace caffe {
 
@@ -40,6 +41,17 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Batched variant of forward_cpu_gemm for num_images consecutive images,
+  // used by the CPU forward pass so that several can run concurrently. With
+  // more than one image their columns are laid out side by side and a single
+  // GEMM covers them all. workspace must hold cpu_workspace_count(num_images)
+  // elements and may not be shared with a concurrent call.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, int num_images, Dtype* workspace);
+  int cpu_workspace_count(int num_images) const;
+  // Bring packed_weights_ up to date with the weights blob. The forward GEMM
+  // helpers use it in place of their weights argument when native_gemm_.
+  void pack_cpu_weights();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,23 +104,23 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief The number of images per forward GEMM on the CPU.
+  int gemm_batch_;
+  /// @brief Workspaces for concurrent forward_cpu_gemm_batch calls.
+  vector<shared_ptr<Blob<Dtype> > > col_buffers_;
+  /// @brief Whether the CPU forward GEMM runs on caffe_cpu_gemm_packed.
+  bool native_gemm_;
+  /// @brief The weights packed for caffe_cpu_gemm_packed when native_gemm_,
+  ///        in the layer's weight_precision.
+  PackedWeights<Dtype> packed_weights_;
+  /// @brief Whether the bottoms and tops are in the blocked NCHW8c layout.
+  bool blocked_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
-  inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
-    if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
-      im2col_cpu(data, conv_in_channels_,
-          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
-          kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
-          pad_.cpu_data()[0], pad_.cpu_data()[1],
-          stride_.cpu_data()[0], stride_.cpu_data()[1],
-          dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
-    } else {
-      im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
-          col_buffer_shape_.data(), kernel_shape_.cpu_data(),
-          pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), col_buff);
-    }
-  }
+  void conv_im2col_cpu(const Dtype* data, Dtype* col_buff);
+  void conv_im2col_channels_cpu(const Dtype* data, Dtype* col_buff,
+      int channel_begin, int channel_end);
   inline void conv_col2im_cpu(const Dtype* col_buff, Dtype* data) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       col2im_cpu(col_buff, conv_in_channels_,
@@ -123,6 +135,17 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // Compute every output channel from col_buff, whose rows are col_dim
+  // long, split over the thread pool.
+  void forward_cpu_gemm_all(const Dtype* weights, const Dtype* col_buff,
+      Dtype* output, int col_dim);
+  // Compute the output channels [row_begin, row_end) of all groups from
+  // col_buff, whose rows are col_dim long.
+  void forward_cpu_gemm_rows(const Dtype* weights, const Dtype* col_buff,
+      Dtype* output, int col_dim, int row_begin, int row_end);
+  // The same for the packed panels [panel_begin, panel_end) of all groups.
+  void forward_cpu_gemm_panels(const Dtype* col_buff, Dtype* output,
+      int col_dim, int panel_begin, int panel_end);
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -26,6 +26,9 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Blocked bottoms are concatenated along the channels, forward only on
+  /// the CPU.
+  virtual inline bool AllowBlockedBottoms() const { return true; }
 
  protected:
   /**
@@ -75,6 +78,11 @@ class ConcatLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Reshape for and run the concatenation of blocked bottoms.
+  void ReshapeBlocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_cpu_blocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   int count_;
   int num_concats_;
@@ -58,6 +58,10 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
+   *  - gemm_batch (\b optional, default 1). The number of images covered by
+   *  one GEMM in the CPU forward pass. Groups of images are also spread over
+   *  the threads set with Caffe::set_num_threads, each with its own column
+   *  buffer.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
    */
@@ -65,6 +69,28 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       : BaseConvolutionLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "Convolution"; }
+  /**
+   * Ungrouped 2D convolutions without dilation also take bottoms in the
+   * blocked NCHW8c layout, and then convolve them directly into blocked tops
+   * on the CPU with no im2col; that path is forward only.
+   */
+  virtual inline bool AllowBlockedBottoms() const { return true; }
+
+  /**
+   * @brief Have Forward_cpu also apply @f$ y = \max(0, x) + a_c \min(0, x)
+   *        @f$ to its output, in the same pass as the bias while each image's
+   *        output is still in cache.
+   *
+   * slopes holds one slope @f$ a_c @f$ per output channel, or a single one
+   * shared by all; it is read at every Forward, so it may be shared with a
+   * PReLU's parameters. Net uses this for an in-place ReLU or PReLU that
+   * directly follows the convolution in a forward-only TEST net, and then
+   * skips that layer in CPU mode. Forward_gpu and Backward are unchanged.
+   */
+  void FuseActivation(const shared_ptr<Blob<Dtype> >& slopes);
+  inline bool has_fused_activation() const {
+    return fused_slopes_.get() != NULL;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +103,23 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+  /// @brief Add the bias (if any) and apply the fused activation.
+  void forward_cpu_bias_activation(Dtype* output, const Dtype* bias);
+  /// @brief Forward the images handled by workers [worker_begin, worker_end).
+  void forward_cpu_workers(const Dtype* bottom_data, const Dtype* weight,
+      Dtype* top_data, int num_workers, int worker_begin, int worker_end);
+  /// @brief The CPU forward pass for blocked bottoms.
+  void forward_cpu_blocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Compute the output rows [row_begin, row_end), counted over the
+  ///        images, then the output channel blocks, then the output height.
+  void forward_cpu_blocked_rows(const Dtype* bottom_data, Dtype* top_data,
+      int row_begin, int row_end);
+
+  shared_ptr<Blob<Dtype> > fused_slopes_;
+  /// @brief The bias and fused slopes zero padded to whole channel blocks.
+  Blob<Dtype> blocked_bias_;
+  Blob<Dtype> blocked_slopes_;
 };
 
 }  // namespace caffe
@@ -42,6 +42,8 @@ class CropLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   vector<int> offsets;
+  /// Whether the top is a contiguous range of the bottom, shared not copied.
+  bool is_view_;
 
  private:
   // Recursive copy function.
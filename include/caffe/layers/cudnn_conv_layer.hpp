@@ -36,6 +36,7 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNConvolutionLayer();
+  virtual inline bool AllowBlockedBottoms() const { return false; }
 
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
@@ -29,6 +29,7 @@ class CuDNNPoolingLayer : public PoolingLayer<Dtype> {
   // Currently, cuDNN does not support the extra top blob.
   virtual inline int MinTopBlobs() const { return -1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool AllowBlockedBottoms() const { return false; }
 
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
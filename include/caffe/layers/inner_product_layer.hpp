@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/packed_weights.hpp"
 
 namespace caffe {
 
@@ -45,6 +46,11 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// @brief Whether the CPU forward runs on caffe_cpu_gemm_packed.
+  bool native_gemm_;
+  PackedWeights<Dtype> packed_weights_;
+  /// @brief The transposed bottom and top of a native forward.
+  Blob<Dtype> native_buffer_;
 };
 
 }  // namespace caffe
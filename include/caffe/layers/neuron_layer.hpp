@@ -25,6 +25,8 @@ class NeuronLayer : public Layer<Dtype> {
 
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Elementwise layers work the same in the blocked NCHW8c layout.
+  virtual inline bool AllowBlockedBottoms() const { return true; }
 };
 
 }  // namespace caffe
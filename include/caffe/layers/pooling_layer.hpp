@@ -33,6 +33,9 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  /// MAX and AVE pooling also take a blocked bottom, forward only on the CPU
+  /// and without a mask top.
+  virtual inline bool AllowBlockedBottoms() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -43,11 +46,27 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Pool the (image, channel) planes [plane_begin, plane_end).
+  void forward_cpu_max(const Dtype* bottom_data, Dtype* top_data, int* mask,
+      Dtype* top_mask, int plane_begin, int plane_end);
+  void forward_cpu_ave(const Dtype* bottom_data, Dtype* top_data,
+      int plane_begin, int plane_end);
+  /**
+   * @brief Max or average pool the planes [plane_begin, plane_end) of an
+   *        unpadded input a row of outputs at a time, without recording
+   *        where the maxima came from; for forward only layers.
+   */
+  void forward_cpu_rows(const Dtype* bottom_data, Dtype* top_data,
+      int plane_begin, int plane_end);
+  /// @brief Max or average pool the planes [plane_begin, plane_end) of a
+  ///        blocked input, each holding one channel block of an image.
+  void forward_cpu_blocked(const Dtype* bottom_data, Dtype* top_data,
+      int plane_begin, int plane_end);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
-  int channels_;
+  int channels_;  // The channel blocks if the bottom is blocked.
   int height_, width_;
   int pooled_height_, pooled_width_;
   bool global_pooling_;
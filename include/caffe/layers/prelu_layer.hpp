@@ -89,6 +89,16 @@ class PReLULayer : public NeuronLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Apply the forward pass to the (image, channel) planes
+  ///        [plane_begin, plane_end), each of dim elements.
+  void forward_cpu_planes(const Dtype* bottom_data, Dtype* top_data,
+      const Dtype* slope_data, int dim, int channels, int plane_begin,
+      int plane_end);
+  /// @brief The same for blocked planes, each holding one channel block of
+  ///        an image; blocks is the number per image.
+  void forward_cpu_blocked_planes(const Dtype* bottom_data, Dtype* top_data,
+      const Dtype* slope_data, int dim, int blocks, int channels,
+      int plane_begin, int plane_end);
 
   bool channel_shared_;
   Blob<Dtype> multiplier_;  // dot multiplier for backward computation of params
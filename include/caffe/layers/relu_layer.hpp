@@ -78,6 +78,9 @@ class ReLULayer : public NeuronLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Apply the forward pass to the elements [begin, end).
+  void forward_cpu_range(const Dtype* bottom_data, Dtype* top_data,
+      Dtype negative_slope, int begin, int end);
 };
 
 }  // namespace caffe
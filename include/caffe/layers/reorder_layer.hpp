@@ -0,0 +1,49 @@
+#ifndef CAFFE_REORDER_LAYER_HPP_
+#define CAFFE_REORDER_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Converts a blob between the plain NCHW layout and the blocked
+ *        NCHW8c one (see Blob::blocked_channels).
+ *
+ * With layout NCHW8C (the default) a 4-axis @f$ (N \times C \times H \times
+ * W) @f$ bottom becomes an @f$ (N \times \lceil C / 8 \rceil \times H \times
+ * W \times 8) @f$ top whose lanes past C are zero; with layout NCHW a blocked
+ * bottom goes back to the plain layout. Net::Init inserts these layers where
+ * a net with blocked_layout changes layouts (see InsertReorders).
+ */
+template <typename Dtype>
+class ReorderLayer : public Layer<Dtype> {
+ public:
+  explicit ReorderLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Reorder"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool AllowBlockedBottoms() const { return true; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Reorders the top diff back into the layout of the bottom.
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief Whether the top is the blocked one.
+  bool to_blocked_;
+  int channels_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_REORDER_LAYER_HPP_
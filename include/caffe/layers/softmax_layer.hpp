@@ -35,6 +35,10 @@ class SoftmaxLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Normalize the flattened (outer, inner) columns
+  ///        [column_begin, column_end).
+  void forward_cpu_columns(const Dtype* bottom_data, Dtype* top_data,
+      int channels, int column_begin, int column_end);
 
   int outer_num_;
   int inner_num_;
@@ -7,6 +7,7 @@
 #include <utility>
 #include <vector>
 
+#include "caffe/activation_arena.hpp"
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
@@ -110,11 +111,43 @@ class Net {
   /**
    * @brief For an already initialized net, copies the pre-trained layers from
    *        another Net.
+   *
+   * The param blobs are decoded concurrently on the threads set up with
+   * Caffe::set_num_threads, largest first.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Use the weights of a mapped weights file (see MappedWeights) in
+   *        place; CopyTrainedLayersFrom picks this for .caffemap files.
+   *
+   * Float nets read and share the mapped pages instead of copying them, and
+   * the mapping lives as long as any blob uses it; other nets copy.
+   */
+  void CopyTrainedLayersFromMapped(const string trained_filename);
+  /**
+   * @brief Create a net with the layers of this one and activations of its
+   *        own, whose layers use this net's parameter blobs, e.g. to run
+   *        inference on several threads at once.
+   *
+   * The net definition is not read or upgraded again and the weights are not
+   * copied, so they exist once in memory however many clones there are, and
+   * the clone's layers are not shared, so they take no lock in Forward. The
+   * clone may only run forward: its parameters are this net's, and changing
+   * them on either net (CopyTrainedLayersFrom, Update, ...) changes both.
+   * Only TEST nets can be cloned. A clone does not inherit the activation
+   * arena, and the Caffe mode is per thread. In GPU mode, run the original
+   * forward once first so that the weights are on the device before several
+   * threads read them.
+   */
+  shared_ptr<Net<Dtype> > CloneForInference() const;
+  /**
+   * @brief Copy the weights that a lazy load left for later (see
+   *        set_lazy_weights) into every layer now.
+   */
+  void LoadPendingWeights() const;
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -217,6 +250,96 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief A hook that Forward runs with the id of each layer before or
+   *        after the layer's forward pass.
+   *
+   * Layers fused into another one are not run and get no calls. Under
+   * set_parallel_forward the hooks run on the threads of the layers, so
+   * calls for different layers may come at the same time.
+   */
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+   protected:
+    virtual void run(int layer) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& before_forward() const { return before_forward_; }
+  void add_before_forward(Callback* value) {
+    before_forward_.push_back(value);
+  }
+  void remove_before_forward(Callback* value);
+  const vector<Callback*>& after_forward() const { return after_forward_; }
+  void add_after_forward(Callback* value) {
+    after_forward_.push_back(value);
+  }
+  void remove_after_forward(Callback* value);
+
+  /**
+   * @brief Run the CPU forward pass of independent layers concurrently on
+   *        the threads set up with Caffe::set_num_threads.
+   *
+   * A layer starts as soon as every earlier layer that writes memory it
+   * reads or writes, or reads memory it writes, is done, so parallel
+   * branches such as separate output heads overlap while the results stay
+   * those of running the layers in order. Losses are summed in layer order.
+   * Each layer then runs its own kernels on a single thread, so this pays
+   * off for branching nets whose layers are too small to split well. It
+   * cannot be combined with an activation arena. NetParameter's
+   * parallel_forward sets the initial value.
+   */
+  void set_parallel_forward(const bool value);
+  inline bool parallel_forward() const { return parallel_forward_; }
+
+  /**
+   * @brief Have CopyTrainedLayersFromBinaryProto check the weights it reads
+   *        against the net but copy each layer's only when a forward pass
+   *        first runs the layer.
+   *
+   * The parameters of a layer keep their initial values until then, so call
+   * LoadPendingWeights before reading them in any other way; ToProto, ToHDF5,
+   * ShareTrainedLayersWith and the other CopyTrainedLayersFrom calls do so
+   * themselves. Clones share the weights left pending with the net they
+   * were cloned from. Only TEST nets can load lazily. NetParameter's
+   * lazy_weights sets the initial value.
+   */
+  void set_lazy_weights(const bool value);
+  inline bool lazy_weights() const { return lazy_weights_; }
+
+  /**
+   * @brief Back the intermediate activations with a shared arena.
+   *
+   * Each CPU forward pass that starts at the first layer reshapes the net
+   * and then binds every top blob that is not a net input, a net output or
+   * the top of a data layer into the arena. Blobs share arena memory when
+   * their lifetimes, from the layer that produces them to the last layer
+   * that reads them, do not overlap, so only the blobs live at the same time
+   * need memory at once. A blob that outgrows its place during the pass,
+   * as when a data layer changes its top shape in Forward, moves to memory
+   * of its own until the next pass binds it again. Blobs named in pin_blob
+   * are kept live for the whole of every later pass. Nets sharing an arena
+   * must not run concurrently, and their intermediate blobs are only valid
+   * until the next pass of any of them. Only TEST nets may use an arena, and
+   * once bound a net keeps using one: an arena may be replaced but not
+   * removed.
+   */
+  void set_activation_arena(const shared_ptr<ActivationArena>& arena);
+  inline const shared_ptr<ActivationArena>& activation_arena() const {
+    return activation_arena_;
+  }
+  /**
+   * @brief Keep an intermediate blob out of the arena's memory reuse, so
+   *        that it still holds its values after each forward pass; call it
+   *        before the first pass whose values you want.
+   */
+  void pin_blob(const string& blob_name);
+  /// @brief Let the arena reuse the memory of a pinned blob again.
+  void unpin_blob(const string& blob_name);
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -229,6 +352,9 @@ class Net {
       const string& layer_name);
 
  protected:
+  /// @brief Initialize a net whose layers use the parameters of param_source.
+  Net(const NetParameter& param, const Net* root_net, const Net* param_source);
+
   // Helpers for Init.
   /// @brief Append a new top blob to the net.
   void AppendTop(const NetParameter& param, const int layer_id,
@@ -242,6 +368,34 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Fuse each in-place ReLU or PReLU that directly follows a
+   *        Convolution into it when neither needs backward (see
+   *        ConvolutionLayer::FuseActivation).
+   */
+  void FuseActivations();
+  /**
+   * @brief Bind the intermediate activations into activation_arena_,
+   *        reusing memory between blobs whose lifetimes do not overlap.
+   */
+  void BindActivations();
+  /// @brief The dependencies and progress of a parallel forward pass.
+  struct ForwardSchedule;
+  /// @brief ForwardFromTo for set_parallel_forward.
+  Dtype ForwardFromToParallel(int start, int end);
+  /// @brief Run ready layers of schedule until none are left to start.
+  void ForwardScheduled(ForwardSchedule* schedule, int worker_begin,
+      int worker_end);
+  /// @brief The weights a lazy load left for later.
+  struct PendingWeights;
+  /**
+   * @brief Find the source blob in param for each param blob of the net,
+   *        listed under the first layer that uses the blob.
+   */
+  void ResolveTrainedLayers(const NetParameter& param,
+      vector<vector<pair<int, const BlobProto*> > >* layer_copies) const;
+  /// @brief Copy the pending weights of the layers from start to end.
+  void LoadPendingWeights(int start, int end) const;
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -306,6 +460,25 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Layers whose CPU forward is done by the layer that feeds them.
+  vector<bool> layer_fused_;
+  /// Whether to run independent layers of the CPU forward concurrently.
+  bool parallel_forward_;
+  /// Whether CopyTrainedLayersFromBinaryProto copies weights on first use.
+  bool lazy_weights_;
+  /// Weights not yet copied into their layers, shared with clones.
+  shared_ptr<PendingWeights> pending_weights_;
+  /// Hooks run around the forward pass of each layer.
+  vector<Callback*> before_forward_;
+  vector<Callback*> after_forward_;
+  /// Optional storage shared by the intermediate activations.
+  shared_ptr<ActivationArena> activation_arena_;
+  /// Blobs named in pin_blob, which the arena never reuses.
+  set<int> pinned_blob_ids_;
+  /// The definition the net was initialized from, without weights.
+  NetParameter net_param_;
+  /// The net whose parameters the layers use, while a clone is initialized.
+  const Net* param_source_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
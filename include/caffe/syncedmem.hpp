@@ -44,17 +44,44 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
  */
 class SyncedMemory {
  public:
+  /// @brief Writes the data of a memory released with release_cpu_data.
+  class Restorer {
+   public:
+    virtual ~Restorer() {}
+    virtual void Restore(void* data) const = 0;
+  };
+
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /**
+   * @brief Use data, which stays valid while owner lives, such as weights
+   *        mapped from a file; this memory keeps a reference to owner.
+   */
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
+  /**
+   * @brief Use data, which holds only size bytes, no more than size(), such
+   *        as a slot of an ActivationArena; the memory shrinks to size, so
+   *        a Blob that grows past it moves to memory of its own.
+   */
+  void set_cpu_data(void* data, size_t size);
+  /**
+   * @brief Free the data, which restorer writes again into new memory the
+   *        next time it is accessed, for data that something else keeps a
+   *        smaller copy of, such as weights packed in 16 bits.
+   *
+   * Neither releasing nor restoring counts as a change of the data. Does
+   * nothing unless the data is on the CPU only.
+   */
+  void release_cpu_data(const shared_ptr<const Restorer>& restorer);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
@@ -62,6 +89,15 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /**
+   * @brief A count of the calls that may have changed the data: the mutable
+   *        accessors and the setters.
+   *
+   * Caches of data derived from the contents compare it to tell whether they
+   * are stale. Writes through a pointer kept from an earlier mutable call are
+   * not counted.
+   */
+  int version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -75,9 +111,12 @@ class SyncedMemory {
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
+  shared_ptr<void> cpu_data_owner_;
+  shared_ptr<const Restorer> restorer_;
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  int version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
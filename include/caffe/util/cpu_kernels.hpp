@@ -0,0 +1,137 @@
+#ifndef CAFFE_UTIL_CPU_KERNELS_HPP_
+#define CAFFE_UTIL_CPU_KERNELS_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+/**
+ * @brief Instruction set levels that the kernels below are built for; each
+ *        level implies the ones before it.
+ *
+ * Every level is compiled into the library and the best one the processor
+ * supports is picked with cpuid at startup, so one build runs everywhere.
+ */
+enum CpuLevel {
+  CPU_LEVEL_BASELINE,  // What the build targets, SSE2 on x86-64.
+  CPU_LEVEL_SSE4,      // SSE4.2; the kernels have no variant of their own.
+  CPU_LEVEL_AVX2,      // AVX2 with FMA.
+  CPU_LEVEL_AVX512     // AVX-512F on top of AVX2.
+};
+
+/// @brief The highest level the processor supports.
+CpuLevel cpu_level_supported();
+/// @brief The level the kernels run at.
+CpuLevel cpu_level();
+/**
+ * @brief Run the kernels at level, capped at cpu_level_supported().
+ *
+ * Lower levels are for comparing variants; do not change the level while
+ * kernels are running.
+ */
+void set_cpu_level(CpuLevel level);
+const char* cpu_level_name(CpuLevel level);
+
+// Float kernels that dispatch on cpu_level(). Arrays need no alignment and
+// the output may be one of the inputs.
+
+/// @brief y = a + b
+void cpu_add(int n, const float* a, const float* b, float* y);
+/// @brief y = a - b
+void cpu_sub(int n, const float* a, const float* b, float* y);
+/// @brief y = a * b
+void cpu_mul(int n, const float* a, const float* b, float* y);
+/// @brief y = a / b
+void cpu_div(int n, const float* a, const float* b, float* y);
+/// @brief y = max(a, b)
+void cpu_max(int n, const float* a, const float* b, float* y);
+/// @brief y = exp(x), within a few ulp of std::exp for x in [-87, 88].
+void cpu_exp(int n, const float* x, float* y);
+/// @brief y = max(x, 0) + slope * min(x, 0)
+void cpu_prelu(int n, const float* x, float slope, float* y);
+/// @brief (y0, y1) = softmax of (x0, x1), for n pairs.
+void cpu_softmax2(int n, const float* x0, const float* x1, float* y0,
+    float* y1);
+
+// A small GEMM for weight matrices that are multiplied many times: A is
+// packed once into panels of kGemmPanelRows rows, and register-blocked
+// kernels multiply each panel by all of B. It beats BLAS on the skinny
+// products of small convolutions, where BLAS spends its time on setup.
+
+/// @brief The rows of A in a packed panel.
+const int kGemmPanelRows = 8;
+
+/// @brief The floats cpu_gemm_pack writes for an M x K matrix.
+inline int cpu_gemm_packed_count(int M, int K) {
+  return (M + kGemmPanelRows - 1) / kGemmPanelRows * kGemmPanelRows * K;
+}
+
+/**
+ * @brief Pack the row-major M x K matrix A for cpu_gemm_packed.
+ *
+ * Each panel holds kGemmPanelRows rows column by column, with the rows past
+ * M zeroed.
+ */
+void cpu_gemm_pack(int M, int K, const float* A, float* packed);
+
+/**
+ * @brief C = A * B, for A packed by cpu_gemm_pack and row-major B (K x N)
+ *        and C (M x N) with leading dimensions ldb and ldc.
+ *
+ * Panel i of A starts i * kGemmPanelRows * K floats into packed, so a range
+ * of panels can be multiplied on its own.
+ */
+void cpu_gemm_packed(int M, int N, int K, const float* packed, const float* B,
+    int ldb, float* C, int ldc);
+
+// Weights can be kept in 16-bit floats, which halves the memory traffic of
+// the kernels that read them; they are widened to floats before use, so all
+// arithmetic stays in single precision.
+
+/// @brief The 16-bit float formats.
+enum HalfFormat {
+  HALF_FP16,  // IEEE binary16: 5 exponent bits and 10 mantissa bits.
+  HALF_BF16   // bfloat16: the upper half of a float.
+};
+
+/// @brief y = x rounded to nearest, ties to even; FP16 overflows to infinity.
+void cpu_float_to_half(int n, const float* x, HalfFormat format, uint16_t* y);
+/// @brief y = x widened to floats, which is exact.
+void cpu_half_to_float(int n, const uint16_t* x, HalfFormat format, float* y);
+
+// A direct 2-D convolution of blobs in the blocked NCHW8c layout (see
+// Blob::blocked_channels), whose blocks are kGemmPanelRows channels wide:
+// each tap of a block of output channels is one vector multiply-add, with
+// no im2col.
+
+/// @brief The geometry of a blocked convolution; sizes are in pixels.
+struct BlockedConvShape {
+  int channels;  // Input channels; the padding lanes past them are not read.
+  int height;
+  int width;
+  int kernel_h;
+  int kernel_w;
+  int pad_h;
+  int pad_w;
+  int stride_h;
+  int stride_w;
+  int output_width;
+};
+
+/**
+ * @brief Compute output row oh of one block of output channels.
+ *
+ * input is one blocked image. weights is the panel of the block's output
+ * channels as cpu_gemm_pack packs the (outputs x channels * kernel_h *
+ * kernel_w) weight matrix, and bias the block's kGemmPanelRows biases. If
+ * slopes is not NULL it holds as many slopes a, and the outputs become
+ * max(x, 0) + a * min(x, 0). output receives output_width pixels of
+ * kGemmPanelRows channels each.
+ */
+void cpu_conv_nchw8c_row(const BlockedConvShape& shape, const float* input,
+    const float* weights, const float* bias, const float* slopes, int oh,
+    float* output);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_KERNELS_HPP_
@@ -0,0 +1,23 @@
+#ifndef _CAFFE_UTIL_INSERT_REORDERS_HPP_
+#define _CAFFE_UTIL_INSERT_REORDERS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the layers that can run in the blocked NCHW8c
+// layout switched to blocked blobs, and ReorderLayers added where blobs
+// change layout. Every ungrouped, undilated 2D Convolution takes blocked
+// bottoms; ReLU, PReLU, max and average Pooling, Eltwise and channel Concat
+// layers do when their bottoms are already blocked. The blocked blobs get
+// their own names, and blobs that are left blocked at the end are reordered
+// back, so the outputs of the net keep their names and layout.
+void InsertReorders(const NetParameter& param, NetParameter* param_reordered);
+
+string BlockedBlobName(const string& blob_name);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_INSERT_REORDERS_HPP_
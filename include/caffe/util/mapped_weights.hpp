@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// @brief Whether filename has the extension of mapped weights files,
+///        .caffemap.
+bool IsMappedWeightsFile(const string& filename);
+
+/**
+ * @brief Write the weights of a NetParameter, as read from a .caffemodel, to
+ *        a mapped weights file.
+ *
+ * The file holds the floats of every blob, in host byte order, at offsets
+ * aligned to 64 bytes, followed by a MappedWeightsIndex and its size, all
+ * between two copies of an 8-byte magic number. Layers without blobs are
+ * left out.
+ */
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+
+/**
+ * @brief A mapped weights file, mapped copy-on-write.
+ *
+ * Float blobs can use the weights in place, with this as the owner of their
+ * data (see Blob::set_cpu_data): processes that map the same file share its
+ * pages through the page cache, pages are only read when first touched, and
+ * a page is only copied when a blob writes to it.
+ */
+class MappedWeights {
+ public:
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  const MappedWeightsIndex& index() const { return index_; }
+  /// @brief The floats of a blob of the index.
+  float* data(const MappedWeightsIndex::BlobLocation& location) const {
+    return reinterpret_cast<float*>(data_ + location.offset());
+  }
+
+ private:
+  char* data_;
+  size_t size_;
+  MappedWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
@@ -7,6 +7,7 @@
 #include "glog/logging.h"
 
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 #include "caffe/util/device_alternate.hpp"
 #include "caffe/util/mkl_alternate.hpp"
 
@@ -20,6 +21,24 @@ void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
     Dtype* C);
 
+// The native GEMM for weights that are multiplied many times: A (M x K) is
+// packed once into caffe_cpu_gemm_packed_count(M, K) elements, which
+// caffe_cpu_gemm_packed then multiplies by B (K x N) into C (M x N), with
+// leading dimensions ldb and ldc. Float runs the cpu_gemm_packed kernels,
+// double a plain loop over the same layout.
+inline int caffe_cpu_gemm_packed_count(const int M, const int K) {
+  return cpu_gemm_packed_count(M, K);
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm_pack(const int M, const int K, const Dtype* A,
+    Dtype* packed);
+
+template <typename Dtype>
+void caffe_cpu_gemm_packed(const int M, const int N, const int K,
+    const Dtype* packed, const Dtype* B, const int ldb, Dtype* C,
+    const int ldc);
+
 template <typename Dtype>
 void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
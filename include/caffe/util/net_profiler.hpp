@@ -0,0 +1,124 @@
+#ifndef CAFFE_UTIL_NET_PROFILER_HPP_
+#define CAFFE_UTIL_NET_PROFILER_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Records the wall time, estimated FLOPs and bytes touched of every
+ *        layer forward of a Net, through its forward callbacks.
+ *
+ * Only every sample_period-th forward of each layer is recorded, so a
+ * profiler can stay attached to a net that serves live traffic; the others
+ * cost two counter updates. Each recorded call adds to the per-layer stats
+ * and, up to max_trace_events of them, to a trace that WriteChromeTrace
+ * exports in the Chrome trace event format (chrome://tracing, Perfetto).
+ *
+ * FLOPs count a multiply-add as two: those of the weights for Convolution,
+ * Deconvolution and InnerProduct layers, and one per top element for other
+ * layers. Bytes count each bottom, top and param blob once. Both are
+ * estimates from the shapes at the time of the call.
+ *
+ * The profiler attaches to the net on construction and detaches on
+ * destruction, which must not happen while the net runs. Stats and the
+ * trace may be read and reset while the net is not running. Layers that
+ * run concurrently under Net::set_parallel_forward are recorded with the
+ * threads they run on.
+ */
+template <typename Dtype>
+class NetProfiler {
+ public:
+  struct LayerStats {
+    LayerStats() : calls(0), total_us(0), min_us(0), max_us(0), flops(0),
+        bytes(0) {}
+    /// The number of recorded calls.
+    int64_t calls;
+    double total_us;
+    double min_us;
+    double max_us;
+    /// Totals over the recorded calls.
+    double flops;
+    double bytes;
+    /// Recorded calls by wall time: bucket 0 counts calls under 1 us and
+    /// bucket b calls from 2^(b-1) up to 2^b us, the last one also longer.
+    vector<int64_t> histogram;
+  };
+
+  explicit NetProfiler(Net<Dtype>* net, int sample_period = 1,
+      int max_trace_events = 1 << 20);
+  ~NetProfiler();
+
+  /// @brief Per-layer stats, indexed by layer id.
+  const vector<LayerStats>& layer_stats() const { return layer_stats_; }
+  /// @brief Forget the stats and the trace.
+  void Reset();
+
+  /// @brief Write the recorded calls as Chrome trace event JSON.
+  void WriteChromeTrace(std::ostream* out) const;
+  /// @brief Write the per-layer stats and histograms as JSON.
+  void WriteHistograms(std::ostream* out) const;
+
+  static const int kHistogramBuckets = 24;
+
+ private:
+  class BeforeForward : public Net<Dtype>::Callback {
+   public:
+    explicit BeforeForward(NetProfiler* profiler) : profiler_(profiler) {}
+   protected:
+    virtual void run(int layer) { profiler_->Begin(layer); }
+    NetProfiler* profiler_;
+  };
+  class AfterForward : public Net<Dtype>::Callback {
+   public:
+    explicit AfterForward(NetProfiler* profiler) : profiler_(profiler) {}
+   protected:
+    virtual void run(int layer) { profiler_->End(layer); }
+    NetProfiler* profiler_;
+  };
+
+  struct TraceEvent {
+    int layer;
+    int thread;
+    int64_t start_us;
+    int64_t duration_us;
+    double flops;
+    double bytes;
+  };
+
+  void Begin(int layer);
+  void End(int layer);
+  double LayerFlops(int layer) const;
+  double LayerBytes(int layer) const;
+
+  Net<Dtype>* net_;
+  const int sample_period_;
+  const int max_trace_events_;
+  BeforeForward before_forward_;
+  AfterForward after_forward_;
+  boost::posix_time::ptime epoch_;
+  // Indexed by layer id; each layer is only touched by the thread running it.
+  vector<int> calls_seen_;
+  vector<boost::posix_time::ptime> starts_;
+  vector<LayerStats> layer_stats_;
+  // Guards the trace.
+  shared_ptr<boost::mutex> mutex_;
+  vector<TraceEvent> trace_;
+  map<string, int> thread_ids_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NET_PROFILER_HPP_
@@ -0,0 +1,23 @@
+#ifndef CAFFE_UTIL_OPTIMIZE_NET_HPP_
+#define CAFFE_UTIL_OPTIMIZE_NET_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy a TEST NetParameter, typically the output of Net::ToProto with its
+// trained blobs, rewritten for inference:
+//   - BatchNorm and Scale layers whose input is used only by them are folded
+//     into the weights and bias of the Convolution or InnerProduct layer
+//     that produces that input (only when the layers carry their blobs);
+//   - Dropout layers, which only copy data at test time, and Split layers
+//     are removed and their consumers read the layer's bottom instead. (Net
+//     inserts the Splits it needs for backward again when it is created.)
+// Blob names that are not consumed by any layer, i.e. the net outputs, are
+// kept. The result can be written out as a caffemodel.
+void OptimizeNetForInference(const NetParameter& param,
+    NetParameter* param_optimized);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_OPTIMIZE_NET_HPP_
@@ -0,0 +1,149 @@
+#ifndef CAFFE_UTIL_PACKED_WEIGHTS_HPP_
+#define CAFFE_UTIL_PACKED_WEIGHTS_HPP_
+
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A weight blob packed for caffe_cpu_gemm_packed, kept until the blob
+ *        is mutated.
+ *
+ * The blob holds num_groups row-major rows x cols matrices, or cols x rows
+ * ones if transposed. Update packs them on the first call and afterwards
+ * only when the data of the blob was replaced, its SyncedMemory version
+ * moved on or the layout changed, so inference with fixed weights packs
+ * once. Packings are shared by the SyncedMemory they come from, so layers
+ * reading the same weights, such as those of the clones of a net, pack them
+ * once between them. In FLOAT16 or BFLOAT16 precision the packed copy is
+ * rounded to 16 bits, and each panel is widened again just before it is
+ * multiplied; with set_release_weights the float weights are then freed.
+ */
+template <typename Dtype>
+class PackedWeights {
+ public:
+  PackedWeights() : version_(0), release_weights_(false) {}
+
+  void Update(const Blob<Dtype>& weights, int num_groups, int rows, int cols,
+      bool transposed = false, Precision precision = FLOAT32);
+
+  /**
+   * @brief Whether Update frees the float data of the weights once they are
+   *        packed in 16 bits, for inference.
+   *
+   * Only data held by a single blob is freed, so weights shared with a net
+   * in training stay. Reading the weights again widens the packed copy back,
+   * which gives the rounded weights.
+   */
+  void set_release_weights(bool value) { release_weights_ = value; }
+
+  Precision precision() const { return packing_->precision; }
+
+  /**
+   * @brief Panel p of group g: kGemmPanelRows rows as caffe_cpu_gemm_pack
+   *        packs them. 16-bit weights are widened into buffer.
+   */
+  const Dtype* panel(int g, int p, std::vector<Dtype>* buffer) const {
+    const Packing& packing = *packing_;
+    const int cols = packing.cols;
+    const int offset = g * packing.group_count + p * kGemmPanelRows * cols;
+    if (packing.precision == FLOAT32) {
+      return &packing.packed[offset];
+    }
+    buffer->resize(kGemmPanelRows * cols);
+    FromHalf(kGemmPanelRows * cols, &packing.half[offset],
+        packing.half_format(), &(*buffer)[0]);
+    return &(*buffer)[0];
+  }
+
+  /**
+   * @brief C = rows [row, row + M) of group g times B, as
+   *        caffe_cpu_gemm_packed; row must start a panel.
+   */
+  void Multiply(int g, int row, int M, int N, const Dtype* B, int ldb,
+      Dtype* C, int ldc) const {
+    CHECK_EQ(row % kGemmPanelRows, 0);
+    const Packing& packing = *packing_;
+    if (packing.precision == FLOAT32) {
+      caffe_cpu_gemm_packed(M, N, packing.cols,
+          &packing.packed[g * packing.group_count + row * packing.cols], B,
+          ldb, C, ldc);
+      return;
+    }
+    std::vector<Dtype> buffer;
+    for (int r = 0; r < M; r += kGemmPanelRows) {
+      caffe_cpu_gemm_packed(std::min(kGemmPanelRows, M - r), N, packing.cols,
+          panel(g, (row + r) / kGemmPanelRows, &buffer), B, ldb,
+          C + r * ldc, ldc);
+    }
+  }
+
+ private:
+  // The packed matrices with their layout; never changed once packed, so
+  // any number of layers can read one.
+  struct Packing : public SyncedMemory::Restorer {
+    int num_groups;
+    int rows;
+    int cols;
+    bool transposed;
+    Precision precision;
+    int group_count;
+    // Only one of the copies is kept.
+    std::vector<Dtype> packed;
+    std::vector<uint16_t> half;
+
+    bool Matches(int num_groups, int rows, int cols, bool transposed,
+        Precision precision) const {
+      return num_groups == this->num_groups && rows == this->rows &&
+          cols == this->cols && transposed == this->transposed &&
+          precision == this->precision;
+    }
+    HalfFormat half_format() const {
+      return precision == FLOAT16 ? HALF_FP16 : HALF_BF16;
+    }
+    void Pack(const Dtype* data);
+    // Widen and unpack the matrices into data.
+    virtual void Restore(void* data) const;
+  };
+
+  // Whether source_ is memory, without touching the reference counts that
+  // the clones of a net share.
+  bool IsSource(const shared_ptr<SyncedMemory>& memory) const {
+    return !source_.owner_before(memory) && !memory.owner_before(source_);
+  }
+
+  static void ToHalf(int n, const float* x, HalfFormat format, uint16_t* y) {
+    cpu_float_to_half(n, x, format, y);
+  }
+  static void ToHalf(int n, const double* x, HalfFormat format, uint16_t* y) {
+    LOG(FATAL) << "16-bit weights are only supported for float.";
+  }
+  static void FromHalf(int n, const uint16_t* x, HalfFormat format,
+      float* y) {
+    cpu_half_to_float(n, x, format, y);
+  }
+  static void FromHalf(int n, const uint16_t* x, HalfFormat format,
+      double* y) {
+    LOG(FATAL) << "16-bit weights are only supported for float.";
+  }
+
+  shared_ptr<const Packing> packing_;
+  // Weak, so that release_weights_ can tell whether other blobs hold it.
+  boost::weak_ptr<SyncedMemory> source_;
+  int version_;
+  bool release_weights_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PACKED_WEIGHTS_HPP_
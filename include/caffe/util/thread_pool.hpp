@@ -0,0 +1,86 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; class mutex; class condition_variable_any; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads that split loops of independent
+ *        iterations with the calling thread.
+ *
+ * Only one ParallelFor runs on a pool at a time. A ParallelFor issued while
+ * another is running, whether nested inside its body or from another
+ * thread, runs serially on the calling thread, so the pool never has more
+ * threads busy than it was created with.
+ */
+class ThreadPool {
+ public:
+  /// @brief num_threads counts the calling thread, so num_threads - 1
+  ///        workers are started.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * @brief Call body(chunk_begin, chunk_end) on contiguous chunks that cover
+   *        [begin, end), each of at least grain iterations, in parallel, and
+   *        return once all of them are done.
+   */
+  void ParallelFor(int begin, int end, int grain,
+      const boost::function<void(int, int)>& body);
+
+ private:
+  void WorkerLoop();
+  void RunChunks();
+
+  const int num_threads_;
+  vector<shared_ptr<boost::thread> > workers_;
+  // Held for the duration of a ParallelFor.
+  shared_ptr<boost::mutex> region_mutex_;
+  // Guards the fields below.
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable_any> work_condition_;
+  shared_ptr<boost::condition_variable_any> done_condition_;
+  bool stop_;
+  int generation_;
+  const boost::function<void(int, int)>* body_;
+  int begin_;
+  int end_;
+  int num_chunks_;
+  int next_chunk_;
+  int pending_chunks_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/**
+ * @brief Run body over [begin, end) on the pool set up with
+ *        Caffe::set_num_threads, or directly when there is none.
+ *
+ * body must be safe to run concurrently on disjoint ranges. grain is the
+ * fewest iterations worth handing to a thread; use it to keep small loops
+ * serial.
+ */
+void ParallelFor(int begin, int end, int grain,
+    const boost::function<void(int, int)>& body);
+
+/// @brief The grain that gives each thread enough work to pay for handing it
+///        out, for loops whose iterations cost about work_per_item
+///        multiply-adds.
+inline int ParallelGrain(int work_per_item) {
+  const int kMinWorkPerThread = 32768;
+  return std::max(1, kMinWorkPerThread / std::max(work_per_item, 1));
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
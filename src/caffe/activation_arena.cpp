@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "caffe/activation_arena.hpp"
+
+namespace caffe {
+
+ActivationArena::ActivationArena()
+    : ptr_(NULL), capacity_(0), peak_(0), window_peak_(0), window_count_(0),
+      trim_window_(64), trim_slack_(2) {}
+
+ActivationArena::~ActivationArena() {
+  Release();
+}
+
+void ActivationArena::set_trim_policy(int window, float slack) {
+  CHECK_GT(window, 0);
+  CHECK_GE(slack, 1);
+  trim_window_ = window;
+  trim_slack_ = slack;
+}
+
+void* ActivationArena::Reserve(size_t size) {
+  peak_ = std::max(peak_, size);
+  window_peak_ = std::max(window_peak_, size);
+  if (++window_count_ >= trim_window_) {
+    if (capacity_ > trim_slack_ * window_peak_) {
+      Resize(window_peak_);
+    }
+    window_count_ = 0;
+    window_peak_ = 0;
+  }
+  if (size > capacity_) {
+    Resize(size);
+  }
+  return ptr_;
+}
+
+void ActivationArena::Release() {
+  free(ptr_);
+  ptr_ = NULL;
+  capacity_ = 0;
+}
+
+void ActivationArena::Resize(size_t size) {
+  Release();
+  if (size == 0) {
+    return;
+  }
+  // posix_memalign wants a multiple of sizeof(void*); Align gives one.
+  size = Align(size);
+  CHECK_EQ(posix_memalign(&ptr_, kAlignment, size), 0)
+      << "activation arena allocation of size " << size << " failed";
+  capacity_ = size;
+}
+
+}  // namespace caffe
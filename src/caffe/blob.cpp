@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -37,10 +38,15 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
-  if (count_ > capacity_) {
+  // The memory may have shrunk below the capacity since it was allocated
+  // (see SyncedMemory::set_cpu_data).
+  if (count_ > capacity_ || (data_ &&
+      (data_offset_ + count_) * sizeof(Dtype) > data_->size())) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_offset_ = 0;
+    diff_offset_ = 0;
   }
 }
 
@@ -57,20 +63,21 @@ void Blob<Dtype>::Reshape(const BlobShape& shape) {
 template <typename Dtype>
 void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.shape());
+  blocked_channels_ = other.blocked_channels_;
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), data_offset_(0), diff_offset_(0), blocked_channels_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), data_offset_(0), diff_offset_(0), blocked_channels_(0) {
   Reshape(shape);
 }
 
@@ -83,67 +90,113 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->cpu_data();
+  return (const Dtype*)data_->cpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  CHECK_EQ(data_offset_, 0) << "Cannot set the data of a view.";
   data_->set_cpu_data(data);
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_data(Dtype* data, const shared_ptr<void>& owner) {
+  CHECK(data);
+  CHECK_EQ(data_offset_, 0) << "Cannot set the data of a view.";
+  data_->set_cpu_data(data, owner);
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->gpu_data();
+  return (const Dtype*)data_->gpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data();
+  return (const Dtype*)diff_->cpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->gpu_data();
+  return (const Dtype*)diff_->gpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_cpu_data());
+  return static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_gpu_data());
+  return static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_cpu_data());
+  return static_cast<Dtype*>(diff_->mutable_cpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_gpu_data());
+  return static_cast<Dtype*>(diff_->mutable_gpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
   data_ = other.data();
+  data_offset_ = other.data_offset();
+  // Reshaping must stay within the shared memory.
+  if (data_) {
+    capacity_ = std::min<int>(capacity_,
+        data_->size() / sizeof(Dtype) - data_offset_);
+  }
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
   diff_ = other.diff();
+  diff_offset_ = other.diff_offset();
+  if (diff_) {
+    capacity_ = std::min<int>(capacity_,
+        diff_->size() / sizeof(Dtype) - diff_offset_);
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareView(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  const int data_offset = other.data_offset() + offset;
+  const int diff_offset = other.diff_offset() + offset;
+  const int data_size = other.data()->size() / sizeof(Dtype);
+  const int diff_size = other.diff()->size() / sizeof(Dtype);
+  CHECK_LE(data_offset + count_, data_size)
+      << "View of " << count_ << " elements at offset " << offset
+      << " exceeds the data of a blob with shape " << other.shape_string();
+  CHECK_LE(diff_offset + count_, diff_size)
+      << "View of " << count_ << " elements at offset " << offset
+      << " exceeds the diff of a blob with shape " << other.shape_string();
+  data_ = other.data();
+  diff_ = other.diff();
+  data_offset_ = data_offset;
+  diff_offset_ = diff_offset;
+  // Reshaping within what the view can see keeps it a view.
+  capacity_ = std::min(data_size - data_offset, diff_size - diff_offset);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Detach() {
+  capacity_ = 0;
+  Reshape(shape_);
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -158,17 +211,13 @@ void Blob<Dtype>::Update() {
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
-    caffe_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->cpu_data()),
-        static_cast<Dtype*>(data_->mutable_cpu_data()));
+    caffe_axpy<Dtype>(count_, Dtype(-1), cpu_diff(), mutable_cpu_data());
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
     // perform computation on GPU
-    caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->gpu_data()),
-        static_cast<Dtype*>(data_->mutable_gpu_data()));
+    caffe_gpu_axpy<Dtype>(count_, Dtype(-1), gpu_diff(), mutable_gpu_data());
 #else
     NO_GPU;
 #endif
@@ -423,20 +472,16 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
-      caffe_copy(count_, source.gpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_diff(), mutable_gpu_diff());
     } else {
-      caffe_copy(count_, source.gpu_data(),
-          static_cast<Dtype*>(data_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_data(), mutable_gpu_data());
     }
     break;
   case Caffe::CPU:
     if (copy_diff) {
-      caffe_copy(count_, source.cpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_diff(), mutable_cpu_diff());
     } else {
-      caffe_copy(count_, source.cpu_data(),
-          static_cast<Dtype*>(data_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_data(), mutable_cpu_data());
     }
     break;
   default:
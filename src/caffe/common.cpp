@@ -5,13 +5,18 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 // Make sure each thread can have different values.
 static boost::thread_specific_ptr<Caffe> thread_instance_;
 
+// Shared by all threads, unlike the rest of Caffe's state.
+static shared_ptr<ThreadPool> thread_pool_;
+
 Caffe& Caffe::Get() {
   if (!thread_instance_.get()) {
     thread_instance_.reset(new Caffe());
@@ -40,6 +45,49 @@ int64_t cluster_seedgen(void) {
 }
 
 
+// Limit BLAS to one thread while the pool is in use, or restore its own
+// setting. Other BLAS libraries are left alone.
+static void LimitBlasThreads(const bool limit) {
+  static int blas_num_threads = 0;  // BLAS's setting while limited
+#if defined(USE_MKL)
+  if (limit && !blas_num_threads) {
+    blas_num_threads = mkl_get_max_threads();
+    mkl_set_num_threads(1);
+  } else if (!limit && blas_num_threads) {
+    mkl_set_num_threads(blas_num_threads);
+    blas_num_threads = 0;
+  }
+#elif defined(USE_OPENBLAS)
+  if (limit && !blas_num_threads) {
+    blas_num_threads = openblas_get_num_threads();
+    openblas_set_num_threads(1);
+  } else if (!limit && blas_num_threads) {
+    openblas_set_num_threads(blas_num_threads);
+    blas_num_threads = 0;
+  }
+#endif
+}
+
+void Caffe::set_num_threads(const int num_threads) {
+  CHECK_GE(num_threads, 1);
+  if (num_threads == Caffe::num_threads()) { return; }
+  thread_pool_.reset();
+  if (num_threads > 1) {
+    thread_pool_.reset(new ThreadPool(num_threads));
+  }
+  // Layers split their work over the pool themselves; a multithreaded BLAS
+  // underneath only adds contention.
+  LimitBlasThreads(num_threads > 1);
+}
+
+int Caffe::num_threads() {
+  return thread_pool_ ? thread_pool_->num_threads() : 1;
+}
+
+ThreadPool* Caffe::thread_pool() {
+  return thread_pool_.get();
+}
+
 void GlobalInit(int* pargc, char*** pargv) {
   // Google flags.
   ::gflags::ParseCommandLineFlags(pargc, pargv, true);
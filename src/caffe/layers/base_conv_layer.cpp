@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +7,7 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -14,9 +17,21 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  gemm_batch_ = conv_param.gemm_batch();
+  CHECK_GE(gemm_batch_, 1) << "gemm_batch must be positive.";
+  // Deconvolution has no forward GEMM to replace. Only the native GEMM
+  // reads 16-bit weights.
+  native_gemm_ = (conv_param.native_gemm() ||
+      this->layer_param_.weight_precision() != FLOAT32) &&
+      !reverse_dimensions();
+  // Then nothing else reads the float weights of an inference net.
+  packed_weights_.set_release_weights(native_gemm_ && this->phase_ == TEST);
+  // A blocked bottom (see Blob::blocked_channels) keeps the lanes of its
+  // channel blocks on an extra last axis.
+  blocked_ = bottom[0]->blocked_channels() > 0;
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
-  const int num_axes = bottom[0]->num_axes();
+  const int num_axes = bottom[0]->num_axes() - (blocked_ ? 1 : 0);
   num_spatial_axes_ = num_axes - first_spatial_axis;
   CHECK_GE(num_spatial_axes_, 0);
   vector<int> bottom_dim_blob_shape(1, num_spatial_axes_ + 1);
@@ -115,10 +130,18 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     if (!is_1x1_) { break; }
   }
   // Configure output channels and groups.
-  channels_ = bottom[0]->shape(channel_axis_);
+  channels_ = blocked_ ? bottom[0]->blocked_channels() :
+      bottom[0]->shape(channel_axis_);
   num_output_ = this->layer_param_.convolution_param().num_output();
   CHECK_GT(num_output_, 0);
   group_ = this->layer_param_.convolution_param().group();
+  if (blocked_) {
+    CHECK(!reverse_dimensions() && !force_nd_im2col_ && channel_axis_ == 1
+        && num_spatial_axes_ == 2 && group_ == 1)
+        << "Blocked bottoms are only taken by ungrouped 2D convolutions.";
+    CHECK(dilation_data[0] == 1 && dilation_data[1] == 1)
+        << "Blocked bottoms are only taken without dilation.";
+  }
   CHECK_EQ(channels_ % group_, 0);
   CHECK_EQ(num_output_ % group_, 0)
       << "Number of output should be multiples of group.";
@@ -186,10 +209,12 @@ template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int first_spatial_axis = channel_axis_ + 1;
-  CHECK_EQ(bottom[0]->num_axes(), first_spatial_axis + num_spatial_axes_)
+  CHECK_EQ(bottom[0]->num_axes(),
+      first_spatial_axis + num_spatial_axes_ + (blocked_ ? 1 : 0))
       << "bottom num_axes may not change.";
   num_ = bottom[0]->count(0, channel_axis_);
-  CHECK_EQ(bottom[0]->shape(channel_axis_), channels_)
+  CHECK_EQ(blocked_ ? bottom[0]->blocked_channels() :
+      bottom[0]->shape(channel_axis_), channels_)
       << "Input size incompatible with convolution kernel.";
   // TODO: generalize to handle inputs of different shapes.
   for (int bottom_id = 1; bottom_id < bottom.size(); ++bottom_id) {
@@ -205,8 +230,14 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < num_spatial_axes_; ++i) {
     top_shape.push_back(output_shape_[i]);
   }
+  if (blocked_) {
+    top_shape[channel_axis_] =
+        (num_output_ + kChannelBlock - 1) / kChannelBlock;
+    top_shape.push_back(kChannelBlock);
+  }
   for (int top_id = 0; top_id < top.size(); ++top_id) {
     top[top_id]->Reshape(top_shape);
+    top[top_id]->set_blocked_channels(blocked_ ? num_output_ : 0);
   }
   if (reverse_dimensions()) {
     conv_out_spatial_dim_ = bottom[0]->count(first_spatial_axis);
@@ -253,6 +284,41 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::conv_im2col_cpu(const Dtype* data,
+    Dtype* col_buff) {
+  if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
+    // Each channel unrolls into its own rows, so the channels are split over
+    // the thread pool.
+    const int* kernel_shape = kernel_shape_.cpu_data();
+    ParallelFor(0, conv_in_channels_,
+        ParallelGrain(kernel_shape[0] * kernel_shape[1] *
+        conv_out_spatial_dim_),
+        boost::bind(&BaseConvolutionLayer<Dtype>::conv_im2col_channels_cpu,
+        this, data, col_buff, _1, _2));
+  } else {
+    im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
+        col_buffer_shape_.data(), kernel_shape_.cpu_data(),
+        pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), col_buff);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::conv_im2col_channels_cpu(const Dtype* data,
+    Dtype* col_buff, int channel_begin, int channel_end) {
+  const int height = conv_input_shape_.cpu_data()[1];
+  const int width = conv_input_shape_.cpu_data()[2];
+  const int* kernel_shape = kernel_shape_.cpu_data();
+  im2col_cpu(data + channel_begin * height * width,
+      channel_end - channel_begin, height, width,
+      kernel_shape[0], kernel_shape[1],
+      pad_.cpu_data()[0], pad_.cpu_data()[1],
+      stride_.cpu_data()[0], stride_.cpu_data()[1],
+      dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+      col_buff + channel_begin * kernel_shape[0] * kernel_shape[1] *
+      conv_out_spatial_dim_);
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
@@ -263,11 +329,111 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     }
     col_buff = col_buffer_.cpu_data();
   }
-  for (int g = 0; g < group_; ++g) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
-        group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
-        (Dtype)0., output + output_offset_ * g);
+  forward_cpu_gemm_all(weights, col_buff, output, conv_out_spatial_dim_);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_all(const Dtype* weights,
+    const Dtype* col_buff, Dtype* output, int col_dim) {
+  if (native_gemm_) {
+    const int group_panels = (conv_out_channels_ / group_ + kGemmPanelRows - 1)
+        / kGemmPanelRows;
+    ParallelFor(0, group_ * group_panels,
+        ParallelGrain(kGemmPanelRows * kernel_dim_ * col_dim),
+        boost::bind(&BaseConvolutionLayer<Dtype>::forward_cpu_gemm_panels,
+        this, col_buff, output, col_dim, _1, _2));
+  } else {
+    ParallelFor(0, conv_out_channels_, ParallelGrain(kernel_dim_ * col_dim),
+        boost::bind(&BaseConvolutionLayer<Dtype>::forward_cpu_gemm_rows, this,
+        weights, col_buff, output, col_dim, _1, _2));
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_rows(const Dtype* weights,
+    const Dtype* col_buff, Dtype* output, int col_dim, int row_begin,
+    int row_end) {
+  const int group_rows = conv_out_channels_ / group_;
+  for (int row = row_begin; row < row_end; ) {
+    const int g = row / group_rows;
+    const int rows = std::min(row_end, (g + 1) * group_rows) - row;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rows, col_dim,
+        kernel_dim_, (Dtype)1., weights + row * kernel_dim_,
+        col_buff + g * kernel_dim_ * col_dim, (Dtype)0., output + row * col_dim);
+    row += rows;
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::pack_cpu_weights() {
+  packed_weights_.Update(*this->blobs_[0], group_, conv_out_channels_ / group_,
+      kernel_dim_, false, this->layer_param_.weight_precision());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_panels(
+    const Dtype* col_buff, Dtype* output, int col_dim, int panel_begin,
+    int panel_end) {
+  const int group_rows = conv_out_channels_ / group_;
+  const int group_panels = (group_rows + kGemmPanelRows - 1) / kGemmPanelRows;
+  for (int panel = panel_begin; panel < panel_end; ) {
+    const int g = panel / group_panels;
+    const int panels = std::min(panel_end, (g + 1) * group_panels) - panel;
+    const int row = (panel - g * group_panels) * kGemmPanelRows;
+    const int rows = std::min(group_rows - row, panels * kGemmPanelRows);
+    packed_weights_.Multiply(g, row, rows, col_dim,
+        col_buff + g * kernel_dim_ * col_dim, col_dim,
+        output + (g * group_rows + row) * col_dim, col_dim);
+    panel += panels;
+  }
+}
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::cpu_workspace_count(int num_images) const {
+  const int col_count = kernel_dim_ * group_ * conv_out_spatial_dim_;
+  if (num_images == 1) {
+    return is_1x1_ ? 1 : col_count;
+  }
+  // The batched columns, the batched output and one image's columns.
+  return (col_count + conv_out_channels_ * conv_out_spatial_dim_) * num_images
+      + (is_1x1_ ? 0 : col_count);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, int num_images, Dtype* workspace) {
+  const int col_rows = kernel_dim_ * group_;
+  const int dim = conv_out_spatial_dim_;
+  const int batch_dim = dim * num_images;
+  if (num_images == 1) {
+    const Dtype* col_buff = input;
+    if (!is_1x1_) {
+      conv_im2col_cpu(input, workspace);
+      col_buff = workspace;
+    }
+    forward_cpu_gemm_all(weights, col_buff, output, dim);
+    return;
+  }
+  Dtype* col_batch = workspace;
+  Dtype* output_batch = col_batch + col_rows * batch_dim;
+  Dtype* col_buff = output_batch + conv_out_channels_ * batch_dim;
+  // Row r of the batched columns holds row r of every image's columns.
+  for (int n = 0; n < num_images; ++n) {
+    const Dtype* image_col = input + n * bottom_dim_;
+    if (!is_1x1_) {
+      conv_im2col_cpu(image_col, col_buff);
+      image_col = col_buff;
+    }
+    for (int r = 0; r < col_rows; ++r) {
+      caffe_copy(dim, image_col + r * dim, col_batch + r * batch_dim + n * dim);
+    }
+  }
+  forward_cpu_gemm_all(weights, col_batch, output_batch, batch_dim);
+  for (int n = 0; n < num_images; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(dim, output_batch + c * batch_dim + n * dim,
+          output + n * top_dim_ + c * dim);
+    }
   }
 }
 
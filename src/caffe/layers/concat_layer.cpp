@@ -16,6 +16,10 @@ void ConcatLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (bottom[0]->blocked_channels()) {
+    ReshapeBlocked(bottom, top);
+    return;
+  }
   const int num_axes = bottom[0]->num_axes();
   const ConcatParameter& concat_param = this->layer_param_.concat_param();
   if (concat_param.has_concat_dim()) {
@@ -46,6 +50,7 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     top_shape[concat_axis_] += bottom[i]->shape(concat_axis_);
   }
   top[0]->Reshape(top_shape);
+  top[0]->set_blocked_channels(0);
   CHECK_EQ(bottom_count_sum, top[0]->count());
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
@@ -53,10 +58,85 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void ConcatLayer<Dtype>::ReshapeBlocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const ConcatParameter& concat_param = this->layer_param_.concat_param();
+  concat_axis_ = concat_param.has_concat_dim() ?
+      static_cast<int>(concat_param.concat_dim()) :
+      bottom[0]->CanonicalAxisIndex(concat_param.axis());
+  CHECK_EQ(concat_axis_, 1) << "Blocked inputs are only concatenated along "
+      << "the channels.";
+  // The channels of a blocked blob pad its last block, so the lanes of every
+  // input after the first may move to other blocks and lanes.
+  int channels = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    CHECK_GT(bottom[i]->blocked_channels(), 0)
+        << "Inputs must be either all blocked or none.";
+    CHECK_EQ(bottom[i]->num_axes(), 5);
+    for (int j = 0; j < 5; ++j) {
+      CHECK(j == 1 || bottom[i]->shape(j) == bottom[0]->shape(j))
+          << "All inputs must have the same shape, except at concat_axis.";
+    }
+    channels += bottom[i]->blocked_channels();
+  }
+  vector<int> top_shape = bottom[0]->shape();
+  top_shape[1] = (channels + kChannelBlock - 1) / kChannelBlock;
+  top[0]->Reshape(top_shape);
+  top[0]->set_blocked_channels(channels);
+  num_concats_ = bottom[0]->shape(0);
+  concat_input_size_ = bottom[0]->count(2);
+  if (bottom.size() == 1) {
+    top[0]->ShareData(*bottom[0]);
+    top[0]->ShareDiff(*bottom[0]);
+  }
+}
+
+template <typename Dtype>
+void ConcatLayer<Dtype>::forward_cpu_blocked(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // concat_input_size_ is one block of an image.
+  const int pixels = concat_input_size_ / kChannelBlock;
+  const int top_blocks = top[0]->shape(1);
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  caffe_set(top[0]->count(), Dtype(0), top_data);
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    const int channels = bottom[i]->blocked_channels();
+    const int bottom_blocks = bottom[i]->shape(1);
+    for (int n = 0; n < num_concats_; ++n) {
+      const Dtype* image = bottom_data + n * bottom_blocks * concat_input_size_;
+      Dtype* top_image = top_data + n * top_blocks * concat_input_size_;
+      if (offset % kChannelBlock == 0) {
+        // Whole blocks; the zero lanes that pad the last one are overwritten
+        // by the next input.
+        caffe_copy(bottom_blocks * concat_input_size_, image,
+            top_image + offset / kChannelBlock * concat_input_size_);
+        continue;
+      }
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* in = image + c / kChannelBlock * concat_input_size_
+            + c % kChannelBlock;
+        Dtype* out = top_image + (offset + c) / kChannelBlock
+            * concat_input_size_ + (offset + c) % kChannelBlock;
+        for (int p = 0; p < pixels; ++p) {
+          out[p * kChannelBlock] = in[p * kChannelBlock];
+        }
+      }
+    }
+    offset += channels;
+  }
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (bottom.size() == 1) { return; }
+  if (bottom[0]->blocked_channels()) {
+    forward_cpu_blocked(bottom, top);
+    return;
+  }
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -77,6 +157,8 @@ template <typename Dtype>
 void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (bottom.size() == 1) { return; }
+  CHECK_EQ(bottom[0]->blocked_channels(), 0)
+      << "Blocked concatenation is forward only.";
   const Dtype* top_diff = top[0]->cpu_diff();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -1,6 +1,11 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -21,34 +26,211 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::FuseActivation(
+    const shared_ptr<Blob<Dtype> >& slopes) {
+  CHECK(slopes);
+  CHECK(slopes->count() == 1 || slopes->count() == this->num_output_)
+      << "Fused activation needs one slope or one per output channel.";
+  fused_slopes_ = slopes;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_bias_activation(Dtype* output,
+    const Dtype* bias) {
+  const Dtype* slopes = fused_slopes_->cpu_data();
+  const int slope_step = fused_slopes_->count() == 1 ? 0 : 1;
+  const int dim = this->out_spatial_dim_;
+  for (int c = 0; c < this->num_output_; ++c) {
+    const Dtype channel_bias = bias ? bias[c] : Dtype(0);
+    const Dtype slope = slopes[c * slope_step];
+    Dtype* channel_output = output + c * dim;
+    for (int i = 0; i < dim; ++i) {
+      const Dtype value = channel_output[i] + channel_bias;
+      channel_output[i] = value > 0 ? value : value * slope;
+    }
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (this->blocked_) {
+    forward_cpu_blocked(bottom, top);
+    return;
+  }
+  // The images are forwarded in groups of gemm_batch_, and the groups are
+  // split over as many workers as there are threads, each of them with its
+  // own column buffer. A single worker instead splits each GEMM.
+  const int gemm_batch = std::min(this->gemm_batch_, this->num_);
+  const int num_gemms = (this->num_ + gemm_batch - 1) / gemm_batch;
+  const int num_workers = std::min(Caffe::num_threads(), num_gemms);
+  if (this->col_buffers_.size() < num_workers) {
+    this->col_buffers_.resize(num_workers);
+  }
+  vector<int> workspace_shape(1, this->cpu_workspace_count(gemm_batch));
+  for (int w = 0; w < num_workers; ++w) {
+    if (!this->col_buffers_[w]) {
+      this->col_buffers_[w].reset(new Blob<Dtype>());
+    }
+    this->col_buffers_[w]->Reshape(workspace_shape);
+  }
+  // The native GEMM reads the packed weights only, which may have freed
+  // the float ones.
+  const Dtype* weight = NULL;
+  if (this->native_gemm_) {
+    this->pack_cpu_weights();
+  } else {
+    weight = this->blobs_[0]->cpu_data();
+  }
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    ParallelFor(0, num_workers, 1,
+        boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_workers, this,
+        bottom[i]->cpu_data(), weight, top[i]->mutable_cpu_data(),
+        num_workers, _1, _2));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_workers(const Dtype* bottom_data,
+    const Dtype* weight, Dtype* top_data, int num_workers, int worker_begin,
+    int worker_end) {
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int gemm_batch = std::min(this->gemm_batch_, this->num_);
+  const int num_gemms = (this->num_ + gemm_batch - 1) / gemm_batch;
+  for (int w = worker_begin; w < worker_end; ++w) {
+    Dtype* workspace = this->col_buffers_[w]->mutable_cpu_data();
+    const int gemm_end = num_gemms * (w + 1) / num_workers;
+    for (int gemm = num_gemms * w / num_workers; gemm < gemm_end; ++gemm) {
+      const int n_begin = gemm * gemm_batch;
+      const int n_end = std::min(this->num_, n_begin + gemm_batch);
+      this->forward_cpu_gemm_batch(bottom_data + n_begin * this->bottom_dim_,
+          weight, top_data + n_begin * this->top_dim_, n_end - n_begin,
+          workspace);
+      for (int n = n_begin; n < n_end; ++n) {
+        if (fused_slopes_) {
+          forward_cpu_bias_activation(top_data + n * this->top_dim_, bias);
+        } else if (bias) {
+          this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+        }
       }
-      /*
-      std::cout <<this->layer_param().name()<<": layer cpu "<<std::endl;
-      for(int i=0;i<20;i++){
-        std::cout<<*(top_data+i)<<' ';
+    }
+  }
+}
+
+namespace {
+
+// One output row of one block of output channels of a blocked convolution;
+// see cpu_conv_nchw8c_row.
+template <typename Dtype>
+void conv_blocked_row(const BlockedConvShape& s, const Dtype* input,
+    const Dtype* weights, const Dtype* bias, const Dtype* slopes, int oh,
+    Dtype* output) {
+  const int plane = s.height * s.width * kChannelBlock;
+  for (int ow = 0; ow < s.output_width; ++ow, output += kChannelBlock) {
+    std::copy(bias, bias + kChannelBlock, output);
+    for (int c = 0; c < s.channels; ++c) {
+      const Dtype* in = input + c / kChannelBlock * plane + c % kChannelBlock;
+      for (int kh = 0; kh < s.kernel_h; ++kh) {
+        const int ih = oh * s.stride_h - s.pad_h + kh;
+        if (ih < 0 || ih >= s.height) { continue; }
+        for (int kw = 0; kw < s.kernel_w; ++kw) {
+          const int iw = ow * s.stride_w - s.pad_w + kw;
+          if (iw < 0 || iw >= s.width) { continue; }
+          const Dtype x = in[(ih * s.width + iw) * kChannelBlock];
+          const Dtype* w = weights
+              + ((c * s.kernel_h + kh) * s.kernel_w + kw) * kChannelBlock;
+          for (int r = 0; r < kChannelBlock; ++r) { output[r] += x * w[r]; }
+        }
       }
-      std::cout << std::endl;
-      */
     }
+    for (int r = 0; slopes && r < kChannelBlock; ++r) {
+      if (output[r] < 0) { output[r] *= slopes[r]; }
+    }
+  }
+}
+
+template <>
+void conv_blocked_row<float>(const BlockedConvShape& s, const float* input,
+    const float* weights, const float* bias, const float* slopes, int oh,
+    float* output) {
+  cpu_conv_nchw8c_row(s, input, weights, bias, slopes, oh, output);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_blocked(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // A block of output channels is a panel of the packed weight matrix.
+  CHECK_EQ(kChannelBlock, kGemmPanelRows);
+  const int kernel_dim = this->blobs_[0]->count(1);
+  this->packed_weights_.Update(*this->blobs_[0], 1, this->num_output_,
+      kernel_dim, false, this->layer_param_.weight_precision());
+  const int padded_outputs = top[0]->shape(1) * kChannelBlock;
+  blocked_bias_.Reshape(vector<int>(1, padded_outputs));
+  Dtype* bias = blocked_bias_.mutable_cpu_data();
+  caffe_set(padded_outputs, Dtype(0), bias);
+  if (this->bias_term_) {
+    caffe_copy(this->num_output_, this->blobs_[1]->cpu_data(), bias);
+  }
+  if (fused_slopes_) {
+    blocked_slopes_.Reshape(vector<int>(1, padded_outputs));
+    Dtype* slopes = blocked_slopes_.mutable_cpu_data();
+    caffe_set(padded_outputs, Dtype(0), slopes);
+    if (fused_slopes_->count() == 1) {
+      caffe_set(this->num_output_, fused_slopes_->cpu_data()[0], slopes);
+    } else {
+      caffe_copy(this->num_output_, fused_slopes_->cpu_data(), slopes);
+    }
+  }
+  const int num_rows = this->num_ * top[0]->shape(1) * this->output_shape_[0];
+  const int row_work = this->output_shape_[1] * kChannelBlock * kernel_dim;
+  for (int i = 0; i < bottom.size(); ++i) {
+    ParallelFor(0, num_rows, ParallelGrain(row_work),
+        boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_blocked_rows, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_blocked_rows(
+    const Dtype* bottom_data, Dtype* top_data, int row_begin, int row_end) {
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const BlockedConvShape shape = {this->channels_, this->input_shape(1),
+      this->input_shape(2), kernel_shape[0], kernel_shape[1], pad[0], pad[1],
+      stride[0], stride[1], this->output_shape_[1]};
+  const int output_height = this->output_shape_[0];
+  const int output_blocks = (this->num_output_ + kChannelBlock - 1)
+      / kChannelBlock;
+  const Dtype* bias = blocked_bias_.cpu_data();
+  const Dtype* slopes = fused_slopes_ ? blocked_slopes_.cpu_data() : NULL;
+  // The rows of a block are consecutive, so 16-bit weights are widened once
+  // per block.
+  vector<Dtype> buffer;
+  const Dtype* weights = NULL;
+  for (int row = row_begin, weights_block = -1; row < row_end; ++row) {
+    const int oh = row % output_height;
+    const int block = row / output_height % output_blocks;
+    const int n = row / output_height / output_blocks;
+    if (block != weights_block) {
+      weights = this->packed_weights_.panel(0, block, &buffer);
+      weights_block = block;
+    }
+    conv_blocked_row(shape, bottom_data + n * this->bottom_dim_,
+        weights, bias + block * kChannelBlock,
+        slopes ? slopes + block * kChannelBlock : NULL, oh,
+        top_data + n * this->top_dim_
+        + (block * output_height + oh) * shape.output_width * kChannelBlock);
   }
 }
 
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!this->blocked_) << "Blocked convolution is forward only.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
@@ -66,6 +66,23 @@ void CropLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     offsets[i] = crop_offset;
   }
   top[0]->Reshape(new_shape);
+  // The crop is one contiguous range of the bottom when every axis after the
+  // last cropped one is kept whole and every axis before it has size 1; the
+  // top is then a view and Forward has nothing to copy.
+  int last_cropped = input_dim - 1;
+  while (last_cropped >= 0 &&
+      new_shape[last_cropped] == bottom[0]->shape(last_cropped)) {
+    --last_cropped;
+  }
+  is_view_ = top[0]->count() > 0;
+  for (int i = 0; i < last_cropped; ++i) {
+    is_view_ &= new_shape[i] == 1;
+  }
+  if (is_view_) {
+    top[0]->ShareView(*bottom[0], bottom[0]->offset(offsets));
+  } else if (top[0]->data() == bottom[0]->data()) {
+    top[0]->Detach();
+  }
 }
 
 template <typename Dtype>
@@ -114,6 +131,7 @@ void CropLayer<Dtype>::crop_copy(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (is_view_) { return; }
   std::vector<int> indices(top[0]->num_axes(), 0);
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
@@ -126,7 +144,14 @@ void CropLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
 
-  if (propagate_down[0]) {
+  if (propagate_down[0] && is_view_) {
+    // The top diff already sits in place; clear the rest.
+    const int begin = bottom[0]->offset(offsets);
+    const int end = begin + top[0]->count();
+    caffe_set(begin, static_cast<Dtype>(0), bottom_diff);
+    caffe_set(bottom[0]->count() - end, static_cast<Dtype>(0),
+        bottom_diff + end);
+  } else if (propagate_down[0]) {
     caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     std::vector<int> indices(top[0]->num_axes(), 0);
     crop_copy(bottom, top, offsets, indices, 0, top_diff, bottom_diff, false);
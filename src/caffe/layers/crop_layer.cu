@@ -90,6 +90,7 @@ void CropLayer<Dtype>::crop_copy_gpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (is_view_) { return; }
   std::vector<int> indices(top[0]->num_axes(), 0);
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
@@ -102,7 +103,13 @@ void CropLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->gpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
 
-  if (propagate_down[0]) {
+  if (propagate_down[0] && is_view_) {
+    const int begin = bottom[0]->offset(offsets);
+    const int end = begin + top[0]->count();
+    caffe_gpu_set(begin, static_cast<Dtype>(0), bottom_diff);
+    caffe_gpu_set(bottom[0]->count() - end, static_cast<Dtype>(0),
+        bottom_diff + end);
+  } else if (propagate_down[0]) {
     caffe_gpu_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     std::vector<int> indices(top[0]->num_axes(), 0);
     crop_copy_gpu(bottom, top, offsets, indices, 0, top_diff, bottom_diff,
@@ -24,6 +24,8 @@ void FlattenLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(top_shape);
   CHECK_EQ(top[0]->count(), bottom[0]->count());
+  // Share already, so that the Net sees the aliasing before Forward.
+  top[0]->ShareData(*bottom[0]);
 }
 
 template <typename Dtype>
@@ -12,6 +12,11 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  // Only the native GEMM reads 16-bit weights.
+  native_gemm_ = this->layer_param_.inner_product_param().native_gemm() ||
+      this->layer_param_.weight_precision() != FLOAT32;
+  // Then nothing else reads the float weights of an inference net.
+  packed_weights_.set_release_weights(native_gemm_ && this->phase_ == TEST);
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -85,10 +90,35 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (native_gemm_) {
+    // top' = weight * bottom', so the weights are the packed operand. A
+    // single input needs no transposes.
+    packed_weights_.Update(*this->blobs_[0], 1, N_, K_, transpose_,
+        this->layer_param_.weight_precision());
+    if (M_ == 1) {
+      packed_weights_.Multiply(0, 0, N_, 1, bottom_data, 1, top_data, 1);
+    } else {
+      native_buffer_.Reshape(vector<int>(1, (K_ + N_) * M_));
+      Dtype* bottom_t = native_buffer_.mutable_cpu_data();
+      Dtype* top_t = bottom_t + K_ * M_;
+      for (int m = 0; m < M_; ++m) {
+        for (int k = 0; k < K_; ++k) {
+          bottom_t[k * M_ + m] = bottom_data[m * K_ + k];
+        }
+      }
+      packed_weights_.Multiply(0, 0, N_, M_, bottom_t, M_, top_t, M_);
+      for (int m = 0; m < M_; ++m) {
+        for (int n = 0; n < N_; ++n) {
+          top_data[m * N_ + n] = top_t[n * M_ + m];
+        }
+      }
+    }
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -1,9 +1,17 @@
+#include <boost/bind.hpp>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -36,8 +44,8 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << "Stride is stride OR stride_h and stride_w are required.";
   global_pooling_ = pool_param.global_pooling();
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = bottom[0]->shape(2);
+    kernel_w_ = bottom[0]->shape(3);
   } else {
     if (pool_param.has_kernel_size()) {
       kernel_h_ = kernel_w_ = pool_param.kernel_size();
@@ -78,14 +86,26 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
-      << "corresponding to (num, channels, height, width)";
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  const bool blocked = bottom[0]->blocked_channels() > 0;
+  if (blocked) {
+    CHECK_EQ(5, bottom[0]->num_axes()) << "Blocked input must have 5 axes, "
+        << "corresponding to (num, channel blocks, height, width, lanes)";
+    CHECK_EQ(1, top.size()) << "Blocked pooling has no mask top.";
+    const PoolingParameter_PoolMethod pool =
+        this->layer_param_.pooling_param().pool();
+    CHECK(pool == PoolingParameter_PoolMethod_MAX ||
+        pool == PoolingParameter_PoolMethod_AVE)
+        << "Blocked pooling is implemented only for max and average pooling.";
+  } else {
+    CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
+        << "corresponding to (num, channels, height, width)";
+  }
+  channels_ = bottom[0]->shape(1);
+  height_ = bottom[0]->shape(2);
+  width_ = bottom[0]->shape(3);
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = height_;
+    kernel_w_ = width_;
   }
   pooled_height_ = static_cast<int>(ceil(static_cast<float>(
       height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
@@ -103,8 +123,17 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
+  if (blocked) {
+    vector<int> top_shape(bottom[0]->shape());
+    top_shape[2] = pooled_height_;
+    top_shape[3] = pooled_width_;
+    top[0]->Reshape(top_shape);
+    top[0]->set_blocked_channels(bottom[0]->blocked_channels());
+    return;
+  }
   top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
+  top[0]->set_blocked_channels(0);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
@@ -134,9 +163,35 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  // Each (image, channel) plane is pooled independently, so the planes are
+  // split over the thread pool.
+  const int num_planes = bottom[0]->shape(0) * channels_;
+  const int grain = ParallelGrain(
+      pooled_height_ * pooled_width_ * kernel_h_ * kernel_w_);
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  if (bottom[0]->blocked_channels()) {
+    ParallelFor(0, num_planes, ParallelGrain(kChannelBlock * pooled_height_
+        * pooled_width_ * kernel_h_ * kernel_w_),
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_blocked, this,
+        bottom_data, top_data, _1, _2));
+    return;
+  }
+  // Without a mask to fill, unpadded windows that are never empty can be
+  // pooled from whole rows at a time.
+  if (this->forward_only_ && !use_top_mask && pad_h_ == 0 && pad_w_ == 0 &&
+      (pooled_height_ - 1) * stride_h_ < height_ &&
+      (pooled_width_ - 1) * stride_w_ < width_ &&
+      (pool == PoolingParameter_PoolMethod_MAX ||
+       pool == PoolingParameter_PoolMethod_AVE)) {
+    ParallelFor(0, num_planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_rows, this, bottom_data,
+        top_data, _1, _2));
+    return;
+  }
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
-  switch (this->layer_param_.pooling_param().pool()) {
+  switch (pool) {
   case PoolingParameter_PoolMethod_MAX:
     // Initialize
     if (use_top_mask) {
@@ -147,88 +202,266 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       caffe_set(top_count, -1, mask);
     }
     caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
+    ParallelFor(0, num_planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_max, this, bottom_data,
+        top_data, mask, top_mask, _1, _2));
+    break;
+  case PoolingParameter_PoolMethod_AVE:
+    for (int i = 0; i < top_count; ++i) {
+      top_data[i] = 0;
+    }
+    ParallelFor(0, num_planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_ave, this, bottom_data,
+        top_data, _1, _2));
+    break;
+  case PoolingParameter_PoolMethod_STOCHASTIC:
+    NOT_IMPLEMENTED;
+    break;
+  default:
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_max(const Dtype* bottom_data,
+    Dtype* top_data, int* mask, Dtype* top_mask, int plane_begin,
+    int plane_end) {
+  const bool use_top_mask = top_mask != NULL;
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  bottom_data += plane_begin * bottom_plane;
+  top_data += plane_begin * top_plane;
+  if (use_top_mask) {
+    top_mask += plane_begin * top_plane;
+  } else {
+    mask += plane_begin * top_plane;
+  }
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_);
+        int wend = min(wstart + kernel_w_, width_);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        const int pool_index = ph * pooled_width_ + pw;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            if (bottom_data[index] > top_data[pool_index]) {
+              top_data[pool_index] = bottom_data[index];
+              if (use_top_mask) {
+                top_mask[pool_index] = static_cast<Dtype>(index);
+              } else {
+                mask[pool_index] = index;
               }
             }
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
+      }
+    }
+    // compute offset
+    bottom_data += bottom_plane;
+    top_data += top_plane;
+    if (use_top_mask) {
+      top_mask += top_plane;
+    } else {
+      mask += top_plane;
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_ave(const Dtype* bottom_data,
+    Dtype* top_data, int plane_begin, int plane_end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  bottom_data += plane_begin * bottom_plane;
+  top_data += plane_begin * top_plane;
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            top_data[ph * pooled_width_ + pw] +=
+                bottom_data[h * width_ + w];
+          }
         }
+        top_data[ph * pooled_width_ + pw] /= pool_size;
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
+    // compute offset
+    bottom_data += bottom_plane;
+    top_data += top_plane;
+  }
+}
+
+namespace {
+
+// Fold a row into acc, keeping the maxima or the sums.
+template <typename Dtype>
+void pool_row(const Dtype* row, int width, bool is_max, Dtype* acc) {
+  if (is_max) {
+    for (int w = 0; w < width; ++w) { acc[w] = max(acc[w], row[w]); }
+  } else {
+    for (int w = 0; w < width; ++w) { acc[w] += row[w]; }
+  }
+}
+
+// Reduce windows of kernel columns at stride 2, four outputs at a time,
+// while the loads stay inside the row; returns how many outputs were done.
+template <typename Dtype>
+int pool_columns_stride2(const Dtype* acc, int width, int kernel,
+    bool is_max, Dtype* out) {
+  return 0;
+}
+
+template <>
+void pool_row<float>(const float* row, int width, bool is_max, float* acc) {
+  if (is_max) {
+    cpu_max(width, acc, row, acc);
+  } else {
+    cpu_add(width, acc, row, acc);
+  }
+}
+
+#ifdef __SSE__
+template <>
+int pool_columns_stride2<float>(const float* acc, int width, int kernel,
+    bool is_max, float* out) {
+  if (kernel != 2 && kernel != 3) { return 0; }
+  // Columns 2i and 2i + 1 of eight loaded values, and for 3x3 columns
+  // 2i + 2 from a load two further on.
+  const int span = kernel == 2 ? 8 : 10;
+  int pw = 0;
+  for (; 2 * pw + span <= width; pw += 4) {
+    const float* in = acc + 2 * pw;
+    const __m128 low = _mm_loadu_ps(in);
+    const __m128 high = _mm_loadu_ps(in + 4);
+    const __m128 even = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 odd = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+    __m128 result = is_max ? _mm_max_ps(even, odd) : _mm_add_ps(even, odd);
+    if (kernel == 3) {
+      const __m128 next = _mm_shuffle_ps(_mm_loadu_ps(in + 2),
+          _mm_loadu_ps(in + 6), _MM_SHUFFLE(2, 0, 2, 0));
+      result = is_max ? _mm_max_ps(result, next) : _mm_add_ps(result, next);
     }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
+    _mm_storeu_ps(out + pw, result);
+  }
+  return pw;
+}
+#endif  // __SSE__
+
+}  // namespace
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_rows(const Dtype* bottom_data,
+    Dtype* top_data, int plane_begin, int plane_end) {
+  const bool is_max = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  bottom_data += plane_begin * bottom_plane;
+  top_data += plane_begin * top_plane;
+  // The rows of each window folded together, so that every output of a row
+  // only has to reduce kernel_w_ columns.
+  vector<Dtype> acc(width_);
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      const int hstart = ph * stride_h_;
+      const int hend = min(hstart + kernel_h_, height_);
+      caffe_copy(width_, bottom_data + hstart * width_, &acc[0]);
+      for (int h = hstart + 1; h < hend; ++h) {
+        pool_row(bottom_data + h * width_, width_, is_max, &acc[0]);
+      }
+      Dtype* top_row = top_data + ph * pooled_width_;
+      int pw = stride_w_ == 2 ? pool_columns_stride2(&acc[0], width_,
+          kernel_w_, is_max, top_row) : 0;
+      for (; pw < pooled_width_; ++pw) {
+        const int wstart = pw * stride_w_;
+        const int wend = min(wstart + kernel_w_, width_);
+        Dtype value = acc[wstart];
+        for (int w = wstart + 1; w < wend; ++w) {
+          value = is_max ? max(value, acc[w]) : value + acc[w];
+        }
+        top_row[pw] = value;
+      }
+      if (!is_max) {
+        for (pw = 0; pw < pooled_width_; ++pw) {
+          const int wstart = pw * stride_w_;
+          const int wend = min(wstart + kernel_w_, width_);
+          top_row[pw] /= (hend - hstart) * (wend - wstart);
+        }
+      }
+    }
+    bottom_data += bottom_plane;
+    top_data += top_plane;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_blocked(const Dtype* bottom_data,
+    Dtype* top_data, int plane_begin, int plane_end) {
+  const bool is_max = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const int bottom_plane = height_ * width_ * kChannelBlock;
+  const int top_plane = pooled_height_ * pooled_width_ * kChannelBlock;
+  bottom_data += plane_begin * bottom_plane;
+  top_data += plane_begin * top_plane;
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    Dtype* out = top_data;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw, out += kChannelBlock) {
+        // The same windows as forward_cpu_max and forward_cpu_ave, with the
+        // lanes of a pixel pooled together.
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        for (int lane = 0; lane < kChannelBlock; ++lane) {
+          out[lane] = is_max ? Dtype(-FLT_MAX) : Dtype(0);
+        }
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = bottom_data + (h * width_ + w) * kChannelBlock;
+            for (int lane = 0; lane < kChannelBlock; ++lane) {
+              out[lane] = is_max ? max(out[lane], in[lane]) :
+                  out[lane] + in[lane];
             }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+        if (!is_max) {
+          for (int lane = 0; lane < kChannelBlock; ++lane) {
+            out[lane] /= pool_size;
+          }
+        }
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
+    bottom_data += bottom_plane;
+    top_data += top_plane;
   }
 }
 
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(bottom[0]->blocked_channels(), 0)
+      << "Blocked pooling is forward only.";
   if (!propagate_down[0]) {
     return;
   }
@@ -247,6 +480,8 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      CHECK(!this->forward_only_)
+          << "Forward only max pooling keeps no mask for Backward.";
       mask = max_idx_.cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
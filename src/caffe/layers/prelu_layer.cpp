@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +7,8 @@
 
 #include "caffe/layers/neuron_layer.hpp"
 #include "caffe/layers/prelu_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -14,7 +18,8 @@ void PReLULayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "Number of axes of bottom blob must be >=2.";
   PReLUParameter prelu_param = this->layer_param().prelu_param();
-  int channels = bottom[0]->channels();
+  int channels = bottom[0]->blocked_channels() ?
+      bottom[0]->blocked_channels() : bottom[0]->shape(1);
   channel_shared_ = prelu_param.channel_shared();
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
@@ -70,21 +75,74 @@ void PReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   const int dim = bottom[0]->count(2);
-  const int channels = bottom[0]->channels();
+  const int channels = bottom[0]->shape(1);
   const Dtype* slope_data = this->blobs_[0]->cpu_data();
 
-  // For in-place computation
-  if (bottom[0] == top[0]) {
+  // For in-place computation; only Backward reads the saved input.
+  if (bottom[0] == top[0] && !this->forward_only_) {
     caffe_copy(count, bottom_data, bottom_memory_.mutable_cpu_data());
   }
 
-  // if channel_shared, channel index in the following computation becomes
-  // always zero.
-  const int div_factor = channel_shared_ ? channels : 1;
-  for (int i = 0; i < count; ++i) {
-    int c = (i / dim) % channels / div_factor;
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + slope_data[c] * std::min(bottom_data[i], Dtype(0));
+  if (bottom[0]->blocked_channels()) {
+    ParallelFor(0, dim ? count / dim : 0, ParallelGrain(dim),
+        boost::bind(&PReLULayer<Dtype>::forward_cpu_blocked_planes, this,
+        bottom_data, top_data, slope_data, dim, channels,
+        bottom[0]->blocked_channels(), _1, _2));
+    return;
+  }
+  ParallelFor(0, dim ? count / dim : 0, ParallelGrain(dim),
+      boost::bind(&PReLULayer<Dtype>::forward_cpu_planes, this, bottom_data,
+      top_data, slope_data, dim, channels, _1, _2));
+}
+
+namespace {
+
+// y = max(x, 0) + slope * min(x, 0) for n values sharing one slope.
+template <typename Dtype>
+void prelu_plane(int n, const Dtype* x, Dtype slope, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::max(x[i], Dtype(0)) + slope * std::min(x[i], Dtype(0));
+  }
+}
+
+template <>
+void prelu_plane<float>(int n, const float* x, float slope, float* y) {
+  cpu_prelu(n, x, slope, y);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void PReLULayer<Dtype>::forward_cpu_planes(const Dtype* bottom_data,
+    Dtype* top_data, const Dtype* slope_data, int dim, int channels,
+    int plane_begin, int plane_end) {
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    const Dtype slope = slope_data[channel_shared_ ? 0 : plane % channels];
+    prelu_plane(dim, bottom_data + plane * dim, slope,
+        top_data + plane * dim);
+  }
+}
+
+template <typename Dtype>
+void PReLULayer<Dtype>::forward_cpu_blocked_planes(const Dtype* bottom_data,
+    Dtype* top_data, const Dtype* slope_data, int dim, int blocks,
+    int channels, int plane_begin, int plane_end) {
+  for (int plane = plane_begin; plane < plane_end; ++plane) {
+    // The lanes past the channels are padding and get slope 0.
+    Dtype slopes[kChannelBlock];
+    for (int lane = 0; lane < kChannelBlock; ++lane) {
+      const int c = plane % blocks * kChannelBlock + lane;
+      slopes[lane] = channel_shared_ ? slope_data[0] :
+          c < channels ? slope_data[c] : Dtype(0);
+    }
+    const Dtype* x = bottom_data + plane * dim;
+    Dtype* y = top_data + plane * dim;
+    for (int i = 0; i < dim; i += kChannelBlock) {
+      for (int lane = 0; lane < kChannelBlock; ++lane) {
+        y[i + lane] = std::max(x[i + lane], Dtype(0))
+            + slopes[lane] * std::min(x[i + lane], Dtype(0));
+      }
+    }
   }
 }
 
@@ -92,6 +150,8 @@ template <typename Dtype>
 void PReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(bottom[0]->blocked_channels(), 0)
+      << "Blocked PReLU is forward only.";
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* slope_data = this->blobs_[0]->cpu_data();
   const Dtype* top_diff = top[0]->cpu_diff();
@@ -101,12 +161,11 @@ void PReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 
   // For in-place computation
   if (top[0] == bottom[0]) {
+    CHECK(!this->forward_only_)
+        << "Forward only in-place PReLU keeps no input for Backward.";
     bottom_data = bottom_memory_.cpu_data();
   }
-
-  // if channel_shared, channel index in the following computation becomes
-  // always zero.
-  const int div_factor = channel_shared_ ? channels : 1;
+  const int num_planes = dim ? count / dim : 0;
 
   // Propagte to param
   // Since to write bottom diff will affect top diff if top and bottom blobs
@@ -114,18 +173,27 @@ void PReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   // keep top_diff unchanged.
   if (this->param_propagate_down_[0]) {
     Dtype* slope_diff = this->blobs_[0]->mutable_cpu_diff();
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      slope_diff[c] += top_diff[i] * bottom_data[i] * (bottom_data[i] <= 0);
+    for (int plane = 0; plane < num_planes; ++plane) {
+      const Dtype* x = bottom_data + plane * dim;
+      const Dtype* dy = top_diff + plane * dim;
+      Dtype sum = 0;
+      for (int i = 0; i < dim; ++i) {
+        sum += dy[i] * x[i] * (x[i] <= 0);
+      }
+      slope_diff[channel_shared_ ? 0 : plane % channels] += sum;
     }
   }
   // Propagate to bottom
   if (propagate_down[0]) {
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    for (int i = 0; i < count; ++i) {
-      int c = (i / dim) % channels / div_factor;
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + slope_data[c] * (bottom_data[i] <= 0));
+    for (int plane = 0; plane < num_planes; ++plane) {
+      const Dtype slope = slope_data[channel_shared_ ? 0 : plane % channels];
+      const Dtype* x = bottom_data + plane * dim;
+      const Dtype* dy = top_diff + plane * dim;
+      Dtype* dx = bottom_diff + plane * dim;
+      for (int i = 0; i < dim; ++i) {
+        dx[i] = dy[i] * ((x[i] > 0) + slope * (x[i] <= 0));
+      }
     }
   }
 }
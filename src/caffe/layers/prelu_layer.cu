@@ -46,6 +46,8 @@ __global__ void PReLUParamBackward(const int n,
 template <typename Dtype>
 void PReLULayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->blocked_channels(), 0)
+      << "Blocked PReLU runs on the CPU only.";
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   const int count = bottom[0]->count();
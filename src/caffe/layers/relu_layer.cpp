@@ -1,18 +1,27 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
+  ParallelFor(0, bottom[0]->count(), ParallelGrain(1),
+      boost::bind(&ReLULayer<Dtype>::forward_cpu_range, this,
+      bottom[0]->cpu_data(), top[0]->mutable_cpu_data(), negative_slope,
+      _1, _2));
+}
+
+template <typename Dtype>
+void ReLULayer<Dtype>::forward_cpu_range(const Dtype* bottom_data,
+    Dtype* top_data, Dtype negative_slope, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
     top_data[i] = std::max(bottom_data[i], Dtype(0))
         + negative_slope * std::min(bottom_data[i], Dtype(0));
   }
@@ -0,0 +1,96 @@
+#include <vector>
+
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Copy the channels of one image from the plain layout to the blocked one,
+// or back. The padding lanes of a blocked image are left alone.
+template <typename Dtype>
+void reorder_image(const Dtype* from, Dtype* to, int channels, int pixels,
+    bool to_blocked) {
+  for (int c = 0; c < channels; ++c) {
+    const int plain = c * pixels;
+    const int blocked = c / kChannelBlock * pixels * kChannelBlock
+        + c % kChannelBlock;
+    if (to_blocked) {
+      for (int p = 0; p < pixels; ++p) {
+        to[blocked + p * kChannelBlock] = from[plain + p];
+      }
+    } else {
+      for (int p = 0; p < pixels; ++p) {
+        to[plain + p] = from[blocked + p * kChannelBlock];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  to_blocked_ = this->layer_param_.reorder_param().layout() ==
+      ReorderParameter_Layout_NCHW8C;
+  vector<int> top_shape(bottom[0]->shape());
+  if (to_blocked_) {
+    CHECK_EQ(bottom[0]->blocked_channels(), 0)
+        << "The input is already blocked.";
+    CHECK_EQ(bottom[0]->num_axes(), 4) << "Input must have 4 axes, "
+        << "corresponding to (num, channels, height, width)";
+    channels_ = bottom[0]->shape(1);
+    top_shape[1] = (channels_ + kChannelBlock - 1) / kChannelBlock;
+    top_shape.push_back(kChannelBlock);
+  } else {
+    CHECK_GT(bottom[0]->blocked_channels(), 0) << "The input is not blocked.";
+    channels_ = bottom[0]->blocked_channels();
+    top_shape[1] = channels_;
+    top_shape.pop_back();
+  }
+  top[0]->Reshape(top_shape);
+  top[0]->set_blocked_channels(to_blocked_ ? channels_ : 0);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  if (to_blocked_) {
+    caffe_set(top[0]->count(), Dtype(0), top_data);
+  }
+  const int num = bottom[0]->shape(0);
+  const int pixels = bottom[0]->shape(2) * bottom[0]->shape(3);
+  for (int n = 0; n < num; ++n) {
+    reorder_image(bottom_data + n * bottom[0]->count(1),
+        top_data + n * top[0]->count(1), channels_, pixels, to_blocked_);
+  }
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (!to_blocked_) {
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  }
+  const int num = bottom[0]->shape(0);
+  const int pixels = bottom[0]->shape(2) * bottom[0]->shape(3);
+  for (int n = 0; n < num; ++n) {
+    reorder_image(top_diff + n * top[0]->count(1),
+        bottom_diff + n * bottom[0]->count(1), channels_, pixels,
+        !to_blocked_);
+  }
+}
+
+INSTANTIATE_CLASS(ReorderLayer);
+REGISTER_LAYER_CLASS(Reorder);
+
+}  // namespace caffe
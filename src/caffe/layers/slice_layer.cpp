@@ -69,13 +69,28 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (num_slices_ == 1) {
+    // Slicing along the outermost non-singleton axis: each top is one
+    // contiguous range of the bottom, so view it instead of copying.
+    int offset = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      top[i]->ShareView(*bottom[0], offset);
+      offset += top[i]->count();
+    }
+  } else {
+    // Stop viewing the bottom if an earlier shape allowed it.
+    for (int i = 0; i < top.size(); ++i) {
+      if (top[i]->data() == bottom[0]->data()) {
+        top[i]->Detach();
+      }
+    }
   }
 }
 
 template <typename Dtype>
 void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (top.size() == 1) { return; }
+  if (top.size() == 1 || num_slices_ == 1) { return; }
   int offset_slice_axis = 0;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
@@ -96,7 +111,7 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (!propagate_down[0] || top.size() == 1) { return; }
+  if (!propagate_down[0] || top.size() == 1 || num_slices_ == 1) { return; }
   int offset_slice_axis = 0;
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
@@ -1,8 +1,13 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/softmax_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -23,39 +28,123 @@ void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   scale_.Reshape(scale_dims);
 }
 
+namespace {
+
+// The columns normalized together, few enough that their channels stay in
+// cache between the passes.
+const int kColumnTile = 64;
+
+// x = exp(x) for n values.
+template <typename Dtype>
+void softmax_exp(int n, Dtype* x) {
+  for (int i = 0; i < n; ++i) { x[i] = std::exp(x[i]); }
+}
+
+// y0, y1 = the softmax of (x0, x1) for n pairs, as 1 / (1 + e) for the
+// larger and e / (1 + e) for the smaller, with e = exp(-|x1 - x0|).
+template <typename Dtype>
+void softmax_two(int n, const Dtype* x0, const Dtype* x1, Dtype* y0,
+    Dtype* y1) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype d = x1[i] - x0[i];
+    const Dtype e = std::exp(-std::abs(d));
+    const Dtype larger = Dtype(1) / (Dtype(1) + e);
+    const Dtype smaller = e * larger;
+    y0[i] = d > 0 ? smaller : larger;
+    y1[i] = d > 0 ? larger : smaller;
+  }
+}
+
+template <>
+void softmax_exp<float>(int n, float* x) {
+  cpu_exp(n, x, x);
+}
+
+template <>
+void softmax_two<float>(int n, const float* x0, const float* x1, float* y0,
+    float* y1) {
+  cpu_softmax2(n, x0, x1, y0, y1);
+}
+
+// y = max(x, y) for n values.
+template <typename Dtype>
+void softmax_max(int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::max(y[i], x[i]); }
+}
+
+template <>
+void softmax_max<float>(int n, const float* x, float* y) {
+  cpu_max(n, x, y, y);
+}
+
+}  // namespace
+
 template <typename Dtype>
 void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int channels = bottom[0]->shape(softmax_axis_);
-  int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num_ + k]);
+  // Every (outer, inner) column is normalized on its own, so the columns are
+  // split over the thread pool; this also spreads the work when outer_num_
+  // is 1, as for the fully convolutional PNet.
+  const int channels = bottom[0]->shape(softmax_axis_);
+  ParallelFor(0, outer_num_ * inner_num_, ParallelGrain(4 * channels),
+      boost::bind(&SoftmaxLayer<Dtype>::forward_cpu_columns, this,
+      bottom[0]->cpu_data(), top[0]->mutable_cpu_data(), channels, _1, _2));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::forward_cpu_columns(const Dtype* bottom_data,
+    Dtype* top_data, int channels, int column_begin, int column_end) {
+  const int dim = channels * inner_num_;
+  Dtype scale[kColumnTile];
+  for (int column = column_begin; column < column_end; ) {
+    // The columns of one outer index that fall in this range.
+    const int i = column / inner_num_;
+    const int k_begin = column - i * inner_num_;
+    const int k_end = std::min(inner_num_, column_end - i * inner_num_);
+    const Dtype* bottom_i = bottom_data + i * dim + k_begin;
+    Dtype* top_i = top_data + i * dim + k_begin;
+    if (channels == 2) {
+      // Two classes, as for face / not face, need a single exp.
+      softmax_two(k_end - k_begin, bottom_i, bottom_i + inner_num_, top_i,
+          top_i + inner_num_);
+      column += k_end - k_begin;
+      continue;
+    }
+    if (inner_num_ == 1) {
+      // The channels of the column are contiguous.
+      const Dtype max_value = *std::max_element(bottom_i, bottom_i + channels);
+      for (int j = 0; j < channels; ++j) {
+        top_i[j] = bottom_i[j] - max_value;
       }
+      softmax_exp(channels, top_i);
+      Dtype sum = 0;
+      for (int j = 0; j < channels; ++j) { sum += top_i[j]; }
+      caffe_scal(channels, Dtype(1) / sum, top_i);
+      ++column;
+      continue;
     }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
+    // We need to subtract the max to avoid numerical issues, compute the exp,
+    // and then normalize.
+    const int n = std::min(k_end - k_begin, kColumnTile);
+    std::copy(bottom_i, bottom_i + n, scale);
+    for (int j = 1; j < channels; ++j) {
+      softmax_max(n, bottom_i + j * inner_num_, scale);
+    }
+    for (int j = 0; j < channels; ++j) {
+      Dtype* top_j = top_i + j * inner_num_;
+      caffe_sub(n, bottom_i + j * inner_num_, scale, top_j);
+      softmax_exp(n, top_j);
+    }
+    std::copy(top_i, top_i + n, scale);
+    for (int j = 1; j < channels; ++j) {
+      caffe_add(n, scale, top_i + j * inner_num_, scale);
+    }
+    for (int k = 0; k < n; ++k) { scale[k] = Dtype(1) / scale[k]; }
+    for (int j = 0; j < channels; ++j) {
+      Dtype* top_j = top_i + j * inner_num_;
+      caffe_mul(n, top_j, scale, top_j);
     }
+    column += n;
   }
 }
 
@@ -1,3 +1,8 @@
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -9,29 +14,63 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+struct Net<Dtype>::PendingWeights {
+  boost::mutex mutex;
+  // The weights read from the file, kept until every layer has its own.
+  NetParameter param;
+  // Indexed by layer id: the params of the layer still to copy, by index,
+  // with their source blobs in param.
+  vector<vector<pair<int, const BlobProto*> > > layer_copies;
+  // Layers with params still to copy, and whether each layer has any. Both
+  // are read without the mutex, so forward passes once a layer has its
+  // weights do not contend on it.
+  boost::atomic<int> num_pending;
+  boost::scoped_array<boost::atomic<bool> > layer_pending;
+
+  explicit PendingWeights(int num_layers)
+      : num_pending(0), layer_pending(new boost::atomic<bool>[num_layers]) {
+    for (int i = 0; i < num_layers; ++i) {
+      layer_pending[i].store(false, boost::memory_order_relaxed);
+    }
+  }
+};
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : param_source_(NULL), root_net_(root_net) {
+  Init(param);
+}
+
+template <typename Dtype>
+Net<Dtype>::Net(const NetParameter& param, const Net* root_net,
+    const Net* param_source)
+    : param_source_(param_source), root_net_(root_net) {
   Init(param);
+  param_source_ = NULL;
 }
 
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
-    : root_net_(root_net) {
+    : param_source_(NULL), root_net_(root_net) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -51,10 +90,28 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  // Keep the definition for CloneForInference; the weights are in the layers.
+  net_param_.CopyFrom(in_param);
+  for (int i = 0; i < net_param_.layer_size(); ++i) {
+    net_param_.mutable_layer(i)->clear_blobs();
+  }
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  if (phase_ == TEST && filtered_param.blocked_layout()) {
+    NetParameter reordered_param;
+    InsertReorders(filtered_param, &reordered_param);
+    filtered_param.Swap(&reordered_param);
+  }
+  if (phase_ == TEST && filtered_param.weight_precision() != FLOAT32) {
+    for (int i = 0; i < filtered_param.layer_size(); ++i) {
+      LayerParameter* layer_param = filtered_param.mutable_layer(i);
+      if (!layer_param->has_weight_precision()) {
+        layer_param->set_weight_precision(filtered_param.weight_precision());
+      }
+    }
+  }
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
@@ -95,6 +152,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       layers_[layer_id]->SetShared(true);
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
+      if (param_source_) {
+        // Taking the source's parameter blobs keeps the layer from
+        // initializing its own in SetUp.
+        CHECK_EQ(layer_param.type(),
+            param_source_->layers_[layer_id]->layer_param().type());
+        layers_[layer_id]->blobs() = param_source_->layers_[layer_id]->blobs();
+      }
     }
     layer_names_.push_back(layer_param.name());
     LOG_IF(INFO, Caffe::root_solver())
@@ -146,6 +210,21 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      if (param_source_) {
+        // Some layers, like the recurrent ones, replace their parameter blobs
+        // in SetUp; point those at the source's data.
+        const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+            param_source_->layers_[layer_id]->blobs();
+        vector<shared_ptr<Blob<Dtype> > >& layer_blobs =
+            layers_[layer_id]->blobs();
+        CHECK_EQ(layer_blobs.size(), source_blobs.size());
+        for (int i = 0; i < layer_blobs.size(); ++i) {
+          if (layer_blobs[i] != source_blobs[i]) {
+            CHECK(layer_blobs[i]->shape() == source_blobs[i]->shape());
+            layer_blobs[i]->ShareData(*source_blobs[i]);
+          }
+        }
+      }
     }
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
@@ -278,8 +357,23 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
-  ShareWeights();
+  // A clone's parameters are already shared the way the source's are, and
+  // still wait for the same pending weights.
+  if (!param_source_) {
+    ShareWeights();
+    pending_weights_.reset(new PendingWeights(layers_.size()));
+  } else {
+    pending_weights_ = param_source_->pending_weights_;
+  }
+  // Layers that Backward never reaches may skip keeping what only it reads.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layers_[layer_id]->set_forward_only(
+        phase_ == TEST && !layer_need_backward_[layer_id]);
+  }
+  FuseActivations();
   debug_info_ = param.debug_info();
+  parallel_forward_ = param.parallel_forward();
+  lazy_weights_ = param.lazy_weights() && phase_ == TEST;
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -544,16 +638,148 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  LoadPendingWeights(start, end);
+  if (activation_arena_ && start == 0 && Caffe::mode() == Caffe::CPU) {
+    BindActivations();
+  }
+  if (parallel_forward_ && Caffe::mode() == Caffe::CPU &&
+      Caffe::thread_pool()) {
+    return ForwardFromToParallel(start, end);
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
+    if (layer_fused_[i] && Caffe::mode() == Caffe::CPU) { continue; }
+    for (int c = 0; c < before_forward_.size(); ++c) {
+      before_forward_[c]->run(i);
+    }
     //LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    for (int c = 0; c < after_forward_.size(); ++c) {
+      after_forward_[c]->run(i);
+    }
   }
   return loss;
 }
 
+template <typename Dtype>
+struct Net<Dtype>::ForwardSchedule {
+  boost::mutex mutex;
+  boost::condition_variable ready_condition;
+  int start;
+  // Layers whose dependencies are done; the lowest id runs first.
+  set<int> ready;
+  // Layers not yet started.
+  int num_left;
+  // Indexed by layer id - start.
+  vector<int> num_pending;
+  vector<vector<int> > successors;
+  vector<Dtype> losses;
+};
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardFromToParallel(int start, int end) {
+  const int num_layers = end - start + 1;
+  ForwardSchedule schedule;
+  schedule.start = start;
+  schedule.num_left = num_layers;
+  schedule.num_pending.resize(num_layers, 0);
+  schedule.successors.resize(num_layers);
+  schedule.losses.resize(num_layers, Dtype(0));
+  // Layers conflict through the blobs they use and through the memory of
+  // those blobs, which covers tops that share the memory of their bottoms
+  // (Split, Reshape, Flatten, ...) and blobs a layer reallocates in Reshape.
+  map<const void*, int> last_writer;
+  map<const void*, vector<int> > readers;
+  for (int i = start; i <= end; ++i) {
+    set<int> dependencies;
+    vector<const void*> reads, writes;
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      reads.push_back(bottom_vecs_[i][j]);
+      reads.push_back(bottom_vecs_[i][j]->data().get());
+    }
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      writes.push_back(top_vecs_[i][j]);
+      writes.push_back(top_vecs_[i][j]->data().get());
+    }
+    for (int j = 0; j < reads.size(); ++j) {
+      if (reads[j] && last_writer.count(reads[j])) {
+        dependencies.insert(last_writer[reads[j]]);
+      }
+    }
+    for (int j = 0; j < writes.size(); ++j) {
+      if (!writes[j]) { continue; }
+      if (last_writer.count(writes[j])) {
+        dependencies.insert(last_writer[writes[j]]);
+      }
+      const vector<int>& write_readers = readers[writes[j]];
+      dependencies.insert(write_readers.begin(), write_readers.end());
+    }
+    for (int j = 0; j < reads.size(); ++j) {
+      if (reads[j]) { readers[reads[j]].push_back(i); }
+    }
+    for (int j = 0; j < writes.size(); ++j) {
+      if (!writes[j]) { continue; }
+      last_writer[writes[j]] = i;
+      readers[writes[j]].clear();
+    }
+    dependencies.erase(i);
+    for (set<int>::const_iterator it = dependencies.begin();
+         it != dependencies.end(); ++it) {
+      schedule.successors[*it - start].push_back(i);
+    }
+    schedule.num_pending[i - start] = dependencies.size();
+    if (dependencies.empty()) {
+      schedule.ready.insert(i);
+    }
+  }
+  ParallelFor(0, Caffe::num_threads(), 1,
+      boost::bind(&Net<Dtype>::ForwardScheduled, this, &schedule, _1, _2));
+  Dtype loss = 0;
+  for (int i = 0; i < num_layers; ++i) {
+    loss += schedule.losses[i];
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardScheduled(ForwardSchedule* schedule,
+    int worker_begin, int worker_end) {
+  // Every worker keeps taking ready layers until all have started, so a
+  // single worker, as when the pool is busy, runs them all in order.
+  boost::mutex::scoped_lock lock(schedule->mutex);
+  for (;;) {
+    while (schedule->ready.empty() && schedule->num_left > 0) {
+      schedule->ready_condition.wait(lock);
+    }
+    if (schedule->num_left == 0) { break; }
+    const int i = *schedule->ready.begin();
+    schedule->ready.erase(schedule->ready.begin());
+    --schedule->num_left;
+    lock.unlock();
+    if (!layer_fused_[i]) {
+      for (int c = 0; c < before_forward_.size(); ++c) {
+        before_forward_[c]->run(i);
+      }
+      schedule->losses[i - schedule->start] =
+          layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      if (debug_info_) { ForwardDebugInfo(i); }
+      for (int c = 0; c < after_forward_.size(); ++c) {
+        after_forward_[c]->run(i);
+      }
+    }
+    lock.lock();
+    const vector<int>& successors = schedule->successors[i - schedule->start];
+    for (int j = 0; j < successors.size(); ++j) {
+      if (--schedule->num_pending[successors[j] - schedule->start] == 0) {
+        schedule->ready.insert(successors[j]);
+      }
+    }
+    schedule->ready_condition.notify_all();
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
@@ -680,6 +906,7 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  other->LoadPendingWeights();
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -739,6 +966,194 @@ void Net<Dtype>::Backward() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::FuseActivations() {
+  layer_fused_.assign(layers_.size(), false);
+  if (phase_ != TEST) { return; }
+  for (int i = 0; i + 1 < layers_.size(); ++i) {
+    ConvolutionLayer<Dtype>* conv_layer =
+        dynamic_cast<ConvolutionLayer<Dtype>*>(layers_[i].get());
+    if (!conv_layer || top_id_vecs_[i].size() != 1 ||
+        layer_need_backward_[i]) {
+      continue;
+    }
+    // The activation must be the next layer to read the output, and work in
+    // place so that every later reader sees the activated values.
+    const int blob_id = top_id_vecs_[i][0];
+    int j = i + 1;
+    while (j < layers_.size() && std::find(bottom_id_vecs_[j].begin(),
+        bottom_id_vecs_[j].end(), blob_id) == bottom_id_vecs_[j].end()) {
+      ++j;
+    }
+    if (j == layers_.size() || layer_need_backward_[j] ||
+        bottom_id_vecs_[j].size() != 1 || top_id_vecs_[j].size() != 1 ||
+        top_id_vecs_[j][0] != blob_id) {
+      continue;
+    }
+    const string type = layers_[j]->type();
+    shared_ptr<Blob<Dtype> > slopes;
+    if (type == "ReLU") {
+      slopes.reset(new Blob<Dtype>(vector<int>(1, 1)));
+      slopes->mutable_cpu_data()[0] =
+          layers_[j]->layer_param().relu_param().negative_slope();
+    } else if (type == "PReLU") {
+      slopes = layers_[j]->blobs()[0];
+      const int channels = blobs_[blob_id]->blocked_channels() ?
+          blobs_[blob_id]->blocked_channels() : blobs_[blob_id]->shape(1);
+      if (slopes->count() != 1 && slopes->count() != channels) {
+        continue;
+      }
+    } else {
+      continue;
+    }
+    conv_layer->FuseActivation(slopes);
+    layer_fused_[j] = true;
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Fusing " << layer_names_[j] << " into " << layer_names_[i];
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_activation_arena(
+    const shared_ptr<ActivationArena>& arena) {
+  CHECK_EQ(phase_, TEST) << "Activation arenas are for inference only.";
+  CHECK(arena) << "Blobs bound to an arena cannot be unbound.";
+  CHECK(!parallel_forward_)
+      << "An activation arena cannot be used with parallel forward.";
+  activation_arena_ = arena;
+}
+
+template <typename Dtype>
+void Net<Dtype>::pin_blob(const string& blob_name) {
+  CHECK(has_blob(blob_name)) << "Unknown blob name " << blob_name;
+  pinned_blob_ids_.insert(blob_names_index_.find(blob_name)->second);
+}
+
+template <typename Dtype>
+void Net<Dtype>::unpin_blob(const string& blob_name) {
+  CHECK(has_blob(blob_name)) << "Unknown blob name " << blob_name;
+  pinned_blob_ids_.erase(blob_names_index_.find(blob_name)->second);
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_parallel_forward(const bool value) {
+  CHECK(!value || !activation_arena_)
+      << "An activation arena cannot be used with parallel forward.";
+  parallel_forward_ = value;
+}
+
+template <typename Dtype>
+void Net<Dtype>::remove_before_forward(Callback* value) {
+  before_forward_.erase(std::remove(before_forward_.begin(),
+      before_forward_.end(), value), before_forward_.end());
+}
+
+template <typename Dtype>
+void Net<Dtype>::remove_after_forward(Callback* value) {
+  after_forward_.erase(std::remove(after_forward_.begin(),
+      after_forward_.end(), value), after_forward_.end());
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_lazy_weights(const bool value) {
+  CHECK(!value || phase_ == TEST) << "Only TEST nets can load lazily.";
+  lazy_weights_ = value;
+}
+
+template <typename Dtype>
+void Net<Dtype>::BindActivations() {
+  // Shapes are only final once every layer has reshaped.
+  Reshape();
+  // Storage the caller can see or that data layers fill stays where it is.
+  // Blobs may share a SyncedMemory (in-place layers, ShareData), so
+  // everything is keyed by SyncedMemory.
+  set<const SyncedMemory*> excluded;
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    excluded.insert(net_input_blobs_[i]->data().get());
+  }
+  for (int i = 0; i < net_output_blobs_.size(); ++i) {
+    excluded.insert(net_output_blobs_[i]->data().get());
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (bottom_vecs_[i].empty()) {
+      for (int j = 0; j < top_vecs_[i].size(); ++j) {
+        excluded.insert(top_vecs_[i][j]->data().get());
+      }
+    }
+  }
+  // Each remaining buffer is live from the first layer that touches it to
+  // the last, inclusive, so a layer's tops never overlap its bottoms. Blobs
+  // the caller asked for by name stay live for the whole pass. Sizes are
+  // what the current shapes need rather than the blobs' historical capacity.
+  vector<SyncedMemory*> memories;
+  map<SyncedMemory*, int> memory_index;
+  vector<size_t> sizes;
+  vector<int> first_use;
+  vector<int> last_use;
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int io = 0; io < 2; ++io) {
+      const vector<int>& blob_ids = io ? top_id_vecs_[i] : bottom_id_vecs_[i];
+      for (int j = 0; j < blob_ids.size(); ++j) {
+        const Blob<Dtype>* blob = blobs_[blob_ids[j]].get();
+        SyncedMemory* memory = blob->data().get();
+        if (memory == NULL || excluded.count(memory)) { continue; }
+        // Views (e.g. Slice tops) cover a range past the beginning.
+        const size_t size = (blob->data_offset() + blob->count()) *
+            sizeof(Dtype);
+        const bool pinned = pinned_blob_ids_.count(blob_ids[j]) > 0;
+        map<SyncedMemory*, int>::iterator it = memory_index.find(memory);
+        if (it == memory_index.end()) {
+          memory_index[memory] = memories.size();
+          memories.push_back(memory);
+          sizes.push_back(size);
+          first_use.push_back(pinned ? 0 : i);
+          last_use.push_back(pinned ? layers_.size() - 1 : i);
+        } else {
+          const int k = it->second;
+          sizes[k] = std::max(sizes[k], size);
+          last_use[k] = pinned ? layers_.size() - 1 : std::max(last_use[k], i);
+          first_use[k] = pinned ? 0 : first_use[k];
+        }
+      }
+    }
+  }
+  // Place the largest buffers first, each at the lowest offset that does not
+  // overlap a placed buffer whose lifetime intersects its own.
+  vector<std::pair<size_t, int> > by_size;
+  for (int k = 0; k < memories.size(); ++k) {
+    by_size.push_back(std::make_pair(ActivationArena::Align(sizes[k]), -k));
+  }
+  std::sort(by_size.rbegin(), by_size.rend());
+  vector<size_t> offsets(memories.size());
+  vector<int> placed;
+  size_t total = 0;
+  for (int n = 0; n < by_size.size(); ++n) {
+    const size_t size = by_size[n].first;
+    const int k = -by_size[n].second;
+    vector<std::pair<size_t, size_t> > busy;
+    for (int p = 0; p < placed.size(); ++p) {
+      const int q = placed[p];
+      if (first_use[q] <= last_use[k] && first_use[k] <= last_use[q]) {
+        busy.push_back(std::make_pair(offsets[q],
+            offsets[q] + ActivationArena::Align(sizes[q])));
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    size_t offset = 0;
+    for (int b = 0; b < busy.size() && offset + size > busy[b].first; ++b) {
+      offset = std::max(offset, busy[b].second);
+    }
+    offsets[k] = offset;
+    placed.push_back(k);
+    total = std::max(total, offset + size);
+  }
+  if (total == 0) { return; }
+  char* base = static_cast<char*>(activation_arena_->Reserve(total));
+  for (int i = 0; i < memories.size(); ++i) {
+    memories[i]->set_cpu_data(base + offsets[i], sizes[i]);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
@@ -747,22 +1162,25 @@ void Net<Dtype>::Reshape() {
 }
 
 template <typename Dtype>
-void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
-  int num_source_layers = param.layer_size();
-  for (int i = 0; i < num_source_layers; ++i) {
+void Net<Dtype>::ResolveTrainedLayers(const NetParameter& param,
+    vector<vector<pair<int, const BlobProto*> > >* layer_copies) const {
+  // Params shared by several layers are copied once, from the last source
+  // layer that has them as a serial copy would leave them, and before the
+  // first layer that uses them runs.
+  map<const SyncedMemory*, const BlobProto*> sources;
+  map<const SyncedMemory*, pair<int, int> > first_uses;
+  for (int i = 0; i < param.layer_size(); ++i) {
     const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    map<string, int>::const_iterator target =
+        layer_names_index_.find(source_layer_name);
+    if (target == layer_names_index_.end()) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
+    const int target_layer_id = target->second;
     DLOG(INFO) << "Copying source layer " << source_layer_name;
-    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+    const vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
     CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
         << "Incompatible number of blobs for layer " << source_layer_name;
@@ -778,10 +1196,79 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
             << "To learn this layer's parameters from scratch rather than "
             << "copying from a saved net, rename the layer.";
       }
-      const bool kReshape = false;
-      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      const SyncedMemory* memory = target_blobs[j]->data().get();
+      sources[memory] = &source_layer.blobs(j);
+      if (!first_uses.count(memory) ||
+          first_uses[memory].first > target_layer_id) {
+        first_uses[memory] = std::make_pair(target_layer_id, j);
+      }
+    }
+  }
+  layer_copies->clear();
+  layer_copies->resize(layers_.size());
+  for (map<const SyncedMemory*, pair<int, int> >::const_iterator it =
+       first_uses.begin(); it != first_uses.end(); ++it) {
+    (*layer_copies)[it->second.first].push_back(
+        std::make_pair(it->second.second, sources[it->first]));
+  }
+}
+
+namespace {
+
+// Param blobs to decode, handed out to the threads one at a time.
+template <typename Dtype>
+struct BlobCopies {
+  boost::mutex mutex;
+  vector<pair<Blob<Dtype>*, const BlobProto*> > copies;
+  int next;
+};
+
+template <typename Dtype>
+bool LargerBlobCopy(const pair<Blob<Dtype>*, const BlobProto*>& a,
+    const pair<Blob<Dtype>*, const BlobProto*>& b) {
+  return a.first->count() > b.first->count();
+}
+
+template <typename Dtype>
+void DecodeBlobCopies(BlobCopies<Dtype>* blob_copies, int worker_begin,
+    int worker_end) {
+  for (;;) {
+    int i;
+    {
+      boost::mutex::scoped_lock lock(blob_copies->mutex);
+      if (blob_copies->next == blob_copies->copies.size()) { return; }
+      i = blob_copies->next++;
+    }
+    const bool kReshape = false;
+    blob_copies->copies[i].first->FromProto(*blob_copies->copies[i].second,
+        kReshape);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  // Weights left pending would otherwise overwrite these later.
+  LoadPendingWeights();
+  vector<vector<pair<int, const BlobProto*> > > layer_copies;
+  ResolveTrainedLayers(param, &layer_copies);
+  // Handing out the largest blobs first keeps one big fully connected layer
+  // from finishing last on its own.
+  BlobCopies<Dtype> blob_copies;
+  blob_copies.next = 0;
+  for (int i = 0; i < layer_copies.size(); ++i) {
+    for (int j = 0; j < layer_copies[i].size(); ++j) {
+      blob_copies.copies.push_back(std::make_pair(
+          layers_[i]->blobs()[layer_copies[i][j].first].get(),
+          layer_copies[i][j].second));
     }
   }
+  std::stable_sort(blob_copies.copies.begin(), blob_copies.copies.end(),
+      LargerBlobCopy<Dtype>);
+  ParallelFor(0, std::min<int>(Caffe::num_threads(),
+      blob_copies.copies.size()), 1,
+      boost::bind(&DecodeBlobCopies<Dtype>, &blob_copies, _1, _2));
 }
 
 template <typename Dtype>
@@ -789,6 +1276,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsMappedWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -797,13 +1286,35 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
+  if (!lazy_weights_) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  LoadPendingWeights();
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  vector<vector<pair<int, const BlobProto*> > > layer_copies;
+  ResolveTrainedLayers(param, &layer_copies);
+  // Clones share pending_weights_, so they see the load too.
+  boost::mutex::scoped_lock lock(pending_weights_->mutex);
+  pending_weights_->param.Swap(&param);
+  pending_weights_->layer_copies.swap(layer_copies);
+  int num_pending = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const bool layer_pending = !pending_weights_->layer_copies[i].empty();
+    pending_weights_->layer_pending[i].store(layer_pending,
+        boost::memory_order_release);
+    num_pending += layer_pending;
+  }
+  pending_weights_->num_pending.store(num_pending,
+      boost::memory_order_release);
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  LoadPendingWeights();
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -852,8 +1363,101 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+namespace {
+
+// Float blobs use the mapped weights in place; others get a copy.
+template <typename Dtype>
+void SetMappedWeights(const shared_ptr<MappedWeights>& weights,
+    const MappedWeightsIndex::BlobLocation& location, Blob<Dtype>* blob) {
+  const float* data = weights->data(location);
+  Dtype* blob_data = blob->mutable_cpu_data();
+  for (int i = 0; i < blob->count(); ++i) {
+    blob_data[i] = data[i];
+  }
+}
+
+template <>
+void SetMappedWeights<float>(const shared_ptr<MappedWeights>& weights,
+    const MappedWeightsIndex::BlobLocation& location, Blob<float>* blob) {
+  blob->set_cpu_data(weights->data(location), weights);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  LoadPendingWeights();
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const MappedWeightsIndex& index = weights->index();
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const MappedWeightsIndex::LayerBlobs& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[layer_names_index_[source_layer_name]]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const MappedWeightsIndex::BlobLocation& location =
+          source_layer.blobs(j);
+      const vector<int> source_shape(location.shape().dim().begin(),
+          location.shape().dim().end());
+      if (target_blobs[j]->shape() != source_shape) {
+        LOG(FATAL) << "Cannot map param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape "
+            << "is " << Blob<Dtype>(source_shape).shape_string() << "; "
+            << "target param shape is " << target_blobs[j]->shape_string();
+      }
+      SetMappedWeights(weights, location, target_blobs[j].get());
+    }
+  }
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > Net<Dtype>::CloneForInference() const {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can be cloned for inference.";
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(net_param_, root_net_, this));
+}
+
+template <typename Dtype>
+void Net<Dtype>::LoadPendingWeights() const {
+  LoadPendingWeights(0, layers_.size() - 1);
+}
+
+template <typename Dtype>
+void Net<Dtype>::LoadPendingWeights(int start, int end) const {
+  PendingWeights* pending = pending_weights_.get();
+  if (pending->num_pending.load(boost::memory_order_acquire) == 0) { return; }
+  int first = start;
+  while (first <= end &&
+         !pending->layer_pending[first].load(boost::memory_order_acquire)) {
+    ++first;
+  }
+  if (first > end) { return; }
+  boost::mutex::scoped_lock lock(pending->mutex);
+  for (int i = first; i <= end && pending->num_pending > 0; ++i) {
+    vector<pair<int, const BlobProto*> >& copies = pending->layer_copies[i];
+    if (copies.empty()) { continue; }
+    for (int j = 0; j < copies.size(); ++j) {
+      const bool kReshape = false;
+      layers_[i]->blobs()[copies[j].first]->FromProto(*copies[j].second,
+          kReshape);
+    }
+    copies.clear();
+    pending->layer_pending[i].store(false, boost::memory_order_release);
+    if (--pending->num_pending == 0) {
+      NetParameter().Swap(&pending->param);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+  LoadPendingWeights();
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -866,6 +1470,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  LoadPendingWeights();
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -968,7 +1573,8 @@ const shared_ptr<Blob<Dtype> > Net<Dtype>::blob_by_name(
     const string& blob_name) const {
   shared_ptr<Blob<Dtype> > blob_ptr;
   if (has_blob(blob_name)) {
-    blob_ptr = blobs_[blob_names_index_.find(blob_name)->second];
+    const int blob_id = blob_names_index_.find(blob_name)->second;
+    blob_ptr = blobs_[blob_id];
   } else {
     blob_ptr.reset((Blob<Dtype>*)(NULL));
     LOG(WARNING) << "Unknown blob name " << blob_name;
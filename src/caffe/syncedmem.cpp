@@ -23,6 +23,12 @@ SyncedMemory::~SyncedMemory() {
 }
 
 inline void SyncedMemory::to_cpu() {
+  if (restorer_) {
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    own_cpu_data_ = true;
+    restorer_->Restore(cpu_ptr_);
+    restorer_.reset();
+  }
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
@@ -59,6 +65,7 @@ inline void SyncedMemory::to_gpu() {
     own_gpu_data_ = true;
     break;
   case HEAD_AT_CPU:
+    to_cpu();
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaGetDevice(&gpu_device_));
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
@@ -82,6 +89,10 @@ const void* SyncedMemory::cpu_data() {
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  set_cpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
   CHECK(data);
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
@@ -89,6 +100,28 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  cpu_data_owner_ = owner;
+  restorer_.reset();
+  ++version_;
+}
+
+void SyncedMemory::set_cpu_data(void* data, size_t size) {
+  CHECK_LE(size, size_);
+  set_cpu_data(data);
+  size_ = size;
+}
+
+void SyncedMemory::release_cpu_data(
+    const shared_ptr<const Restorer>& restorer) {
+  CHECK(restorer);
+  if (head_ != HEAD_AT_CPU) { return; }
+  if (own_cpu_data_) {
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  }
+  cpu_ptr_ = NULL;
+  own_cpu_data_ = false;
+  cpu_data_owner_.reset();
+  restorer_ = restorer;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -116,6 +149,8 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  restorer_.reset();
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -124,6 +159,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -131,6 +167,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -141,6 +178,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   CHECK(head_ == HEAD_AT_CPU);
+  to_cpu();
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaGetDevice(&gpu_device_));
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
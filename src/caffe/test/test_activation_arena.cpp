@@ -0,0 +1,292 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/activation_arena.hpp"
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ActivationArenaTest : public ::testing::Test {};
+
+TEST_F(ActivationArenaTest, TestReserve) {
+  ActivationArena arena;
+  EXPECT_EQ(arena.capacity(), 0);
+  void* ptr = arena.Reserve(100);
+  EXPECT_TRUE(ptr);
+  EXPECT_EQ(reinterpret_cast<size_t>(ptr) % ActivationArena::kAlignment, 0);
+  EXPECT_GE(arena.capacity(), 100);
+  // Smaller requests reuse the buffer.
+  EXPECT_EQ(arena.Reserve(10), ptr);
+  arena.Reserve(1000);
+  EXPECT_GE(arena.capacity(), 1000);
+  EXPECT_EQ(arena.peak(), 1000);
+  arena.Release();
+  EXPECT_EQ(arena.capacity(), 0);
+}
+
+TEST_F(ActivationArenaTest, TestTrim) {
+  ActivationArena arena;
+  arena.set_trim_policy(4, 2);
+  arena.Reserve(1000);
+  // The spike is still within the first window.
+  for (int i = 0; i < 3; ++i) {
+    arena.Reserve(10);
+  }
+  EXPECT_GE(arena.capacity(), 1000);
+  // A whole window of small requests gives the memory back.
+  for (int i = 0; i < 4; ++i) {
+    arena.Reserve(10);
+  }
+  EXPECT_LT(arena.capacity(), 1000);
+  EXPECT_GE(arena.capacity(), 10);
+  EXPECT_EQ(arena.peak(), 1000);
+}
+
+template <typename Dtype>
+class NetActivationArenaTest : public CPUDeviceTest<Dtype> {
+ protected:
+  shared_ptr<Net<Dtype> > MakeNet(int num, int size) {
+    std::ostringstream proto;
+    proto <<
+        "name: 'ArenaTestNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: " << num << " dim: 3 "
+        "      dim: " << size << " dim: " << size << " } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'constant' value: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'pool' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv' "
+        "  top: 'pool' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "} "
+        "layer { "
+        "  name: 'flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'pool' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  void FillInput(Net<Dtype>* net, Net<Dtype>* reference) {
+    Blob<Dtype>* data = net->blob_by_name("data").get();
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(data);
+    reference->blob_by_name("data")->CopyFrom(*data);
+  }
+
+  void ExpectSameOutput(Net<Dtype>* net, Net<Dtype>* reference) {
+    const Blob<Dtype>* prob = net->blob_by_name("prob").get();
+    const Blob<Dtype>* expected = reference->blob_by_name("prob").get();
+    ASSERT_EQ(prob->count(), expected->count());
+    for (int i = 0; i < prob->count(); ++i) {
+      EXPECT_EQ(prob->cpu_data()[i], expected->cpu_data()[i]);
+    }
+  }
+};
+
+TYPED_TEST_CASE(NetActivationArenaTest, TestDtypes);
+
+TYPED_TEST(NetActivationArenaTest, TestForward) {
+  shared_ptr<Net<TypeParam> > reference = this->MakeNet(2, 9);
+  shared_ptr<Net<TypeParam> > net = this->MakeNet(2, 9);
+  net->ShareTrainedLayersWith(reference.get());
+  shared_ptr<ActivationArena> arena(new ActivationArena());
+  net->set_activation_arena(arena);
+  this->FillInput(net.get(), reference.get());
+  const TypeParam* data = net->blob_by_name("data")->cpu_data();
+  const TypeParam* prob = net->blob_by_name("prob")->cpu_data();
+  reference->Forward();
+  net->Forward();
+  this->ExpectSameOutput(net.get(), reference.get());
+  // Inputs and outputs keep their own storage.
+  EXPECT_EQ(net->blob_by_name("data")->cpu_data(), data);
+  EXPECT_EQ(net->blob_by_name("prob")->cpu_data(), prob);
+  // conv is shared in place with relu, and laid out first. pool is live at
+  // the same time as conv, and flat is the same buffer as pool.
+  const TypeParam* conv = net->blob_by_name("conv")->cpu_data();
+  const TypeParam* pool = net->blob_by_name("pool")->cpu_data();
+  EXPECT_EQ(reinterpret_cast<const char*>(pool),
+      reinterpret_cast<const char*>(conv) +
+      ActivationArena::Align(2 * 4 * 7 * 7 * sizeof(TypeParam)));
+  EXPECT_EQ(net->blob_by_name("flat")->cpu_data(), pool);
+  // conv is dead by the time ip is computed, so ip reuses its memory.
+  EXPECT_EQ(net->blob_by_name("ip")->cpu_data(), conv);
+  EXPECT_EQ(arena->peak(),
+      ActivationArena::Align(2 * 4 * 7 * 7 * sizeof(TypeParam)) +
+      ActivationArena::Align(2 * 4 * 4 * 4 * sizeof(TypeParam)));
+}
+
+TYPED_TEST(NetActivationArenaTest, TestPinnedBlob) {
+  shared_ptr<Net<TypeParam> > reference = this->MakeNet(2, 9);
+  shared_ptr<Net<TypeParam> > net = this->MakeNet(2, 9);
+  net->ShareTrainedLayersWith(reference.get());
+  shared_ptr<ActivationArena> arena(new ActivationArena());
+  net->set_activation_arena(arena);
+  // Pinning conv keeps it intact until the end of the very first pass.
+  net->pin_blob("conv");
+  this->FillInput(net.get(), reference.get());
+  reference->Forward();
+  net->Forward();
+  this->ExpectSameOutput(net.get(), reference.get());
+  const Blob<TypeParam>* conv = net->blob_by_name("conv").get();
+  EXPECT_NE(net->blob_by_name("ip")->cpu_data(), conv->cpu_data());
+  const Blob<TypeParam>* expected = reference->blob_by_name("conv").get();
+  for (int i = 0; i < conv->count(); ++i) {
+    EXPECT_EQ(conv->cpu_data()[i], expected->cpu_data()[i]);
+  }
+  // Unpinned, its memory is reused again from the next pass on.
+  net->unpin_blob("conv");
+  net->Forward();
+  this->ExpectSameOutput(net.get(), reference.get());
+  EXPECT_EQ(net->blob_by_name("ip")->cpu_data(), conv->cpu_data());
+}
+
+// Grows the input in the middle of a pass, as a data layer that changes its
+// top shape in Forward would.
+template <typename Dtype>
+class GrowInput : public Net<Dtype>::Callback {
+ public:
+  GrowInput(Blob<Dtype>* data, const Blob<Dtype>& source)
+      : data_(data), source_(source) {}
+
+ protected:
+  virtual void run(int layer) {
+    if (layer == 1) {
+      data_->CopyFrom(source_, false, true);
+    }
+  }
+
+ private:
+  Blob<Dtype>* data_;
+  const Blob<Dtype>& source_;
+};
+
+TYPED_TEST(NetActivationArenaTest, TestGrowDuringForward) {
+  shared_ptr<Net<TypeParam> > reference = this->MakeNet(4, 12);
+  shared_ptr<Net<TypeParam> > net = this->MakeNet(4, 12);
+  net->ShareTrainedLayersWith(reference.get());
+  shared_ptr<ActivationArena> arena(new ActivationArena());
+  net->set_activation_arena(arena);
+  net->Forward();
+  // The blobs keep the capacity for four images, but the slots are planned
+  // for one, and then conv and pool get four again.
+  vector<int> shape = net->blob_by_name("data")->shape();
+  shape[0] = 1;
+  net->blob_by_name("data")->Reshape(shape);
+  this->FillInput(reference.get(), reference.get());
+  GrowInput<TypeParam> grow(net->blob_by_name("data").get(),
+      *reference->blob_by_name("data"));
+  net->add_before_forward(&grow);
+  reference->Forward();
+  net->Forward();
+  net->remove_before_forward(&grow);
+  this->ExpectSameOutput(net.get(), reference.get());
+  // The next pass plans for the new shapes.
+  net->Forward();
+  this->ExpectSameOutput(net.get(), reference.get());
+}
+
+TYPED_TEST(NetActivationArenaTest, TestSharedArena) {
+  shared_ptr<Net<TypeParam> > small_reference = this->MakeNet(1, 8);
+  shared_ptr<Net<TypeParam> > large_reference = this->MakeNet(3, 12);
+  shared_ptr<Net<TypeParam> > small = this->MakeNet(1, 8);
+  shared_ptr<Net<TypeParam> > large = this->MakeNet(3, 12);
+  small->ShareTrainedLayersWith(small_reference.get());
+  large->ShareTrainedLayersWith(large_reference.get());
+  shared_ptr<ActivationArena> arena(new ActivationArena());
+  small->set_activation_arena(arena);
+  large->set_activation_arena(arena);
+  for (int iter = 0; iter < 3; ++iter) {
+    this->FillInput(small.get(), small_reference.get());
+    this->FillInput(large.get(), large_reference.get());
+    small_reference->Forward();
+    large_reference->Forward();
+    small->Forward();
+    large->Forward();
+    // The large pass reused the small pass's memory; outputs survive.
+    this->ExpectSameOutput(small.get(), small_reference.get());
+    this->ExpectSameOutput(large.get(), large_reference.get());
+  }
+  EXPECT_EQ(small->blob_by_name("conv")->cpu_data(),
+      large->blob_by_name("conv")->cpu_data());
+}
+
+TYPED_TEST(NetActivationArenaTest, TestReshapeShrinks) {
+  shared_ptr<Net<TypeParam> > reference = this->MakeNet(4, 10);
+  shared_ptr<Net<TypeParam> > net = this->MakeNet(4, 10);
+  net->ShareTrainedLayersWith(reference.get());
+  shared_ptr<ActivationArena> arena(new ActivationArena());
+  arena->set_trim_policy(2, 1);
+  net->set_activation_arena(arena);
+  this->FillInput(net.get(), reference.get());
+  net->Forward();
+  const size_t large_capacity = arena->capacity();
+  // Blob capacity never shrinks, but the arena only holds what the current
+  // shapes need and is trimmed once the window passes.
+  vector<int> shape = net->blob_by_name("data")->shape();
+  shape[0] = 1;
+  net->blob_by_name("data")->Reshape(shape);
+  reference->blob_by_name("data")->Reshape(shape);
+  for (int i = 0; i < 4; ++i) {
+    this->FillInput(net.get(), reference.get());
+    reference->Forward();
+    net->Forward();
+    this->ExpectSameOutput(net.get(), reference.get());
+  }
+  EXPECT_LT(arena->capacity(), large_capacity);
+}
+
+}  // namespace caffe
@@ -59,6 +59,65 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareView) {
+  Blob<TypeParam>* const batch = this->blob_preshaped_;
+  TypeParam* batch_data = batch->mutable_cpu_data();
+  for (int i = 0; i < batch->count(); ++i) {
+    batch_data[i] = i;
+  }
+  Blob<TypeParam> view(1, 3, 4, 5);
+  view.ShareView(*batch, batch->offset(1));
+  EXPECT_EQ(view.data_offset(), 60);
+  EXPECT_EQ(view.cpu_data(), batch->cpu_data() + 60);
+  EXPECT_EQ(view.data_at(0, 2, 3, 4), batch->data_at(1, 2, 3, 4));
+  // Writes go straight to the viewed blob.
+  view.mutable_cpu_data()[0] = -1;
+  EXPECT_EQ(batch->data_at(1, 0, 0, 0), -1);
+  view.mutable_cpu_diff()[0] = 1;
+  EXPECT_EQ(batch->diff_at(1, 0, 0, 0), 1);
+  // Sharing a view's data keeps its offset; views of views compose.
+  Blob<TypeParam> shared(1, 3, 4, 5);
+  shared.ShareData(view);
+  EXPECT_EQ(shared.cpu_data(), view.cpu_data());
+  Blob<TypeParam> sub_view(1, 1, 4, 5);
+  sub_view.ShareView(view, view.offset(0, 2));
+  EXPECT_EQ(sub_view.data_at(0, 0, 1, 1), batch->data_at(1, 2, 1, 1));
+  // Update only touches the viewed range.
+  view.Update();
+  EXPECT_EQ(batch->data_at(1, 0, 0, 0), -2);
+  EXPECT_EQ(batch->data_at(0, 0, 0, 0), 0);
+  // Reshaping within the visible range stays a view; beyond it detaches.
+  view.Reshape(1, 3, 4, 4);
+  EXPECT_EQ(view.cpu_data(), batch->cpu_data() + 60);
+  view.Reshape(2, 3, 4, 5);
+  EXPECT_EQ(view.data_offset(), 0);
+  EXPECT_NE(view.data(), batch->data());
+  view.ShareView(*batch, 0);
+  view.Detach();
+  EXPECT_NE(view.data(), batch->data());
+  EXPECT_EQ(view.count(), 120);
+}
+
+TYPED_TEST(BlobSimpleTest, TestShareDataOfViewReshape) {
+  Blob<TypeParam>* const batch = this->blob_preshaped_;
+  Blob<TypeParam> view(1, 3, 4, 5);
+  view.ShareView(*batch, batch->offset(1));
+  // A blob with room for the whole batch shares the view, which only has
+  // the second image left after its offset.
+  Blob<TypeParam> shared(2, 3, 4, 5);
+  shared.Reshape(1, 3, 4, 5);
+  shared.ShareData(view);
+  shared.ShareDiff(view);
+  EXPECT_EQ(shared.cpu_data(), batch->cpu_data() + 60);
+  // Growing past the end of the shared memory allocates its own.
+  shared.Reshape(2, 3, 4, 5);
+  EXPECT_EQ(shared.data_offset(), 0);
+  EXPECT_EQ(shared.diff_offset(), 0);
+  EXPECT_NE(shared.data(), batch->data());
+  EXPECT_NE(shared.diff(), batch->diff());
+  EXPECT_EQ(shared.data()->size(), 120 * sizeof(TypeParam));
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
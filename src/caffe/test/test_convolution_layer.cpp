@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -495,6 +497,233 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestGemmBatchConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Five images in GEMMs of two, spread over three threads on the CPU.
+  this->blob_bottom_->Reshape(5, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->set_gemm_batch(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Caffe::set_num_threads(3);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Caffe::set_num_threads(1);
+  // Check against reference convolution.
+  const Dtype* top_data;
+  const Dtype* ref_top_data;
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestNativeGemmConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Eleven outputs per group leave a partial panel, and 7 x 5 outputs per
+  // image a partial block of columns, both alone and batched.
+  this->blob_bottom_->Reshape(5, 4, 9, 7);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(22);
+  convolution_param->set_group(2);
+  convolution_param->set_native_gemm(true);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  for (int gemm_batch = 1; gemm_batch <= 2; ++gemm_batch) {
+    convolution_param->set_gemm_batch(gemm_batch);
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    Caffe::set_num_threads(3);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Caffe::set_num_threads(1);
+    // Check against reference convolution.
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestNativeGemmWeightUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_native_gemm(true);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The weights are packed again once they change.
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  caffe_scal(weights->count(), Dtype(-2), weights->mutable_cpu_data());
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBlockedConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The blocked layout is for the CPU only.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // 11 channels and 13 outputs leave partial blocks, and the padding makes
+  // borders on every side of rows with interior runs of pixels.
+  this->blob_bottom_->Reshape(2, 11, 9, 13);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter reorder_param;
+  ReorderLayer<Dtype> to_blocked(reorder_param);
+  reorder_param.mutable_reorder_param()->set_layout(
+      ReorderParameter_Layout_NCHW);
+  ReorderLayer<Dtype> to_plain(reorder_param);
+  Blob<Dtype> blocked_bottom, blocked_top;
+  vector<Blob<Dtype>*> blocked_bottom_vec(1, &blocked_bottom);
+  vector<Blob<Dtype>*> blocked_top_vec(1, &blocked_top);
+  to_blocked.SetUp(this->blob_bottom_vec_, blocked_bottom_vec);
+  to_blocked.Forward(this->blob_bottom_vec_, blocked_bottom_vec);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(13);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(blocked_bottom_vec, blocked_top_vec);
+  ASSERT_EQ(blocked_top.num_axes(), 5);
+  EXPECT_EQ(blocked_top.shape(1), 2);
+  EXPECT_EQ(blocked_top.shape(2), 5);
+  EXPECT_EQ(blocked_top.shape(3), 7);
+  EXPECT_EQ(blocked_top.blocked_channels(), 13);
+  to_plain.SetUp(blocked_top_vec, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  for (int level = CPU_LEVEL_BASELINE; level <= cpu_level_supported();
+       ++level) {
+    set_cpu_level(static_cast<CpuLevel>(level));
+    Caffe::set_num_threads(3);
+    layer.Forward(blocked_bottom_vec, blocked_top_vec);
+    Caffe::set_num_threads(1);
+    to_plain.Forward(blocked_top_vec, this->blob_top_vec_);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4)
+          << cpu_level_name(cpu_level());
+    }
+  }
+  set_cpu_level(cpu_level_supported());
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestHalfPrecisionWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 16-bit weights are for the CPU forward of float nets.
+  if (Caffe::mode() != Caffe::CPU || sizeof(Dtype) != 4) { return; }
+  this->blob_bottom_->Reshape(2, 11, 9, 13);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter reorder_param;
+  ReorderLayer<Dtype> to_blocked(reorder_param);
+  reorder_param.mutable_reorder_param()->set_layout(
+      ReorderParameter_Layout_NCHW);
+  ReorderLayer<Dtype> to_plain(reorder_param);
+  Blob<Dtype> blocked_bottom, blocked_top;
+  vector<Blob<Dtype>*> blocked_bottom_vec(1, &blocked_bottom);
+  vector<Blob<Dtype>*> blocked_top_vec(1, &blocked_top);
+  to_blocked.SetUp(this->blob_bottom_vec_, blocked_bottom_vec);
+  to_blocked.Forward(this->blob_bottom_vec_, blocked_bottom_vec);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(13);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  const Precision precisions[] = {FLOAT16, BFLOAT16};
+  for (int p = 0; p < 2; ++p) {
+    layer_param.set_weight_precision(precisions[p]);
+    const HalfFormat format = precisions[p] == FLOAT16 ? HALF_FP16 : HALF_BF16;
+    // Both the packed GEMM and the blocked convolution read the weights.
+    for (int blocked = 0; blocked <= 1; ++blocked) {
+      ConvolutionLayer<Dtype> layer(layer_param);
+      if (blocked) {
+        layer.SetUp(blocked_bottom_vec, blocked_top_vec);
+        to_plain.SetUp(blocked_top_vec, this->blob_top_vec_);
+        layer.Forward(blocked_bottom_vec, blocked_top_vec);
+        to_plain.Forward(blocked_top_vec, this->blob_top_vec_);
+      } else {
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      }
+      // The reference convolves with the weights rounded the same way.
+      vector<shared_ptr<Blob<Dtype> > > rounded(2);
+      for (int i = 0; i < 2; ++i) {
+        rounded[i].reset(new Blob<Dtype>());
+        rounded[i]->CopyFrom(*layer.blobs()[i], false, true);
+      }
+      Dtype* weights = rounded[0]->mutable_cpu_data();
+      for (int i = 0; i < rounded[0]->count(); ++i) {
+        const float weight = weights[i];
+        uint16_t half;
+        float widened;
+        cpu_float_to_half(1, &weight, format, &half);
+        cpu_half_to_float(1, &half, format, &widened);
+        weights[i] = widened;
+      }
+      caffe_conv(this->blob_bottom_, convolution_param, rounded,
+          this->MakeReferenceTop(this->blob_top_));
+      const Dtype* top_data = this->blob_top_->cpu_data();
+      const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+      for (int i = 0; i < this->blob_top_->count(); ++i) {
+        EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -0,0 +1,184 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CpuKernelsTest : public ::testing::Test {
+ protected:
+  // Sizes that leave a tail at every vector width, and inputs that start
+  // off the alignment of any of them.
+  CpuKernelsTest() : n_(45), a_(vector<int>(1, n_ + 1)),
+      b_(vector<int>(1, n_ + 1)) {
+    FillerParameter filler_param;
+    filler_param.set_std(4);
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(&a_);
+    filler.Fill(&b_);
+  }
+  virtual ~CpuKernelsTest() { set_cpu_level(cpu_level_supported()); }
+
+  const float* a() const { return a_.cpu_data() + 1; }
+  const float* b() const { return b_.cpu_data() + 1; }
+
+  const int n_;
+  Blob<float> a_;
+  Blob<float> b_;
+};
+
+TEST_F(CpuKernelsTest, TestSetLevel) {
+  set_cpu_level(CPU_LEVEL_BASELINE);
+  EXPECT_EQ(cpu_level(), CPU_LEVEL_BASELINE);
+  set_cpu_level(CPU_LEVEL_AVX512);
+  EXPECT_EQ(cpu_level(), cpu_level_supported());
+}
+
+TEST_F(CpuKernelsTest, TestEveryLevel) {
+  vector<float> y(n_), y1(n_);
+  for (int level = CPU_LEVEL_BASELINE; level <= cpu_level_supported();
+       ++level) {
+    set_cpu_level(static_cast<CpuLevel>(level));
+    const char* name = cpu_level_name(cpu_level());
+    cpu_add(n_, a(), b(), &y[0]);
+    for (int i = 0; i < n_; ++i) { EXPECT_EQ(y[i], a()[i] + b()[i]) << name; }
+    cpu_sub(n_, a(), b(), &y[0]);
+    for (int i = 0; i < n_; ++i) { EXPECT_EQ(y[i], a()[i] - b()[i]) << name; }
+    cpu_mul(n_, a(), b(), &y[0]);
+    for (int i = 0; i < n_; ++i) { EXPECT_EQ(y[i], a()[i] * b()[i]) << name; }
+    cpu_div(n_, a(), b(), &y[0]);
+    for (int i = 0; i < n_; ++i) { EXPECT_EQ(y[i], a()[i] / b()[i]) << name; }
+    cpu_max(n_, a(), b(), &y[0]);
+    for (int i = 0; i < n_; ++i) {
+      EXPECT_EQ(y[i], std::max(a()[i], b()[i])) << name;
+    }
+    cpu_exp(n_, a(), &y[0]);
+    for (int i = 0; i < n_; ++i) {
+      const float expected = std::exp(a()[i]);
+      EXPECT_NEAR(y[i], expected, 1e-6 * expected) << name;
+    }
+    cpu_prelu(n_, a(), 0.25f, &y[0]);
+    for (int i = 0; i < n_; ++i) {
+      EXPECT_FLOAT_EQ(y[i], a()[i] > 0 ? a()[i] : 0.25f * a()[i]) << name;
+    }
+    cpu_softmax2(n_, a(), b(), &y[0], &y1[0]);
+    for (int i = 0; i < n_; ++i) {
+      const double e0 = std::exp(static_cast<double>(a()[i]));
+      const double e1 = std::exp(static_cast<double>(b()[i]));
+      EXPECT_NEAR(y[i], e0 / (e0 + e1), 1e-6) << name;
+      EXPECT_NEAR(y1[i], e1 / (e0 + e1), 1e-6) << name;
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestExpSpecialValues) {
+  // Each value fills both the vector body and the scalar tail, which have to
+  // agree with std::exp on infinities, NaN, overflow and denormal results.
+  const float inf = std::numeric_limits<float>::infinity();
+  const float values[] = {inf, -inf, std::numeric_limits<float>::quiet_NaN(),
+      1000.f, -1000.f, 100.f, -100.f, 89.5f, 88.7f, -95.f, -87.5f};
+  const int num_values = sizeof(values) / sizeof(values[0]);
+  vector<float> x(n_), y(n_);
+  for (int level = CPU_LEVEL_BASELINE; level <= cpu_level_supported();
+       ++level) {
+    set_cpu_level(static_cast<CpuLevel>(level));
+    const char* name = cpu_level_name(cpu_level());
+    for (int v = 0; v < num_values; ++v) {
+      std::fill(x.begin(), x.end(), values[v]);
+      cpu_exp(n_, &x[0], &y[0]);
+      const float expected = std::exp(values[v]);
+      for (int i = 0; i < n_; ++i) {
+        if (isnan(expected)) {
+          EXPECT_TRUE(isnan(y[i])) << name << " at " << i;
+        } else if (isinf(expected) || expected == 0) {
+          EXPECT_EQ(y[i], expected) << name << " exp(" << values[v] << ")";
+        } else {
+          EXPECT_NEAR(y[i], expected, 1e-6 * expected + 1e-44)
+              << name << " exp(" << values[v] << ")";
+        }
+      }
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestGemmPacked) {
+  // 11 x 9 times 9 x 19 into a wider C: a partial panel and partial blocks
+  // of columns at every width.
+  const int M = 11, N = 19, K = 9, ldc = 21;
+  Blob<float> a(vector<int>(1, M * K)), b(vector<int>(1, K * N));
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&a);
+  filler.Fill(&b);
+  vector<float> expected(M * N);
+  caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M, N, K, 1.f,
+      a.cpu_data(), b.cpu_data(), 0.f, &expected[0]);
+  vector<float> packed(cpu_gemm_packed_count(M, K));
+  cpu_gemm_pack(M, K, a.cpu_data(), &packed[0]);
+  for (int level = CPU_LEVEL_BASELINE; level <= cpu_level_supported();
+       ++level) {
+    set_cpu_level(static_cast<CpuLevel>(level));
+    vector<float> c(M * ldc, 7.f);
+    cpu_gemm_packed(M, N, K, &packed[0], b.cpu_data(), N, &c[0], ldc);
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        EXPECT_NEAR(c[i * ldc + j], expected[i * N + j], 1e-5)
+            << cpu_level_name(cpu_level());
+      }
+      // The columns past N are left alone.
+      EXPECT_EQ(c[i * ldc + N], 7.f);
+      EXPECT_EQ(c[i * ldc + N + 1], 7.f);
+    }
+  }
+}
+
+TEST_F(CpuKernelsTest, TestHalfConversion) {
+  // Ties to even, the largest values, overflow and subnormals.
+  const float fp16_values[] = {1.f, -2.5f, 1.f + 1.f / 2048,
+      1.f + 3.f / 2048, 65504.f, 65519.f, 65520.f, 1.f / (1 << 24),
+      1.f / (1 << 25), 3.f / (1 << 25)};
+  const uint16_t fp16[] = {0x3c00, 0xc100, 0x3c00, 0x3c02, 0x7bff, 0x7bff,
+      0x7c00, 0x0001, 0x0000, 0x0002};
+  const float bf16_values[] = {1.f, -2.5f, 1.f + 1.f / 256, 1.f + 3.f / 256};
+  const uint16_t bf16[] = {0x3f80, 0xc020, 0x3f80, 0x3f82};
+  uint16_t h[10];
+  cpu_float_to_half(10, fp16_values, HALF_FP16, h);
+  for (int i = 0; i < 10; ++i) { EXPECT_EQ(h[i], fp16[i]) << i; }
+  cpu_float_to_half(4, bf16_values, HALF_BF16, h);
+  for (int i = 0; i < 4; ++i) { EXPECT_EQ(h[i], bf16[i]) << i; }
+  // Every FP16 number but NaN survives the round trip.
+  vector<uint16_t> all(0x10000), back(0x10000);
+  for (int i = 0; i < 0x10000; ++i) { all[i] = i; }
+  vector<float> widened(0x10000);
+  for (int level = CPU_LEVEL_BASELINE; level <= cpu_level_supported();
+       ++level) {
+    set_cpu_level(static_cast<CpuLevel>(level));
+    const char* name = cpu_level_name(cpu_level());
+    cpu_half_to_float(0x10000, &all[0], HALF_FP16, &widened[0]);
+    cpu_float_to_half(0x10000, &widened[0], HALF_FP16, &back[0]);
+    for (int i = 0; i < 0x10000; ++i) {
+      if ((i & 0x7c00) == 0x7c00 && (i & 0x3ff)) { continue; }
+      EXPECT_EQ(back[i], all[i]) << name;
+    }
+    cpu_half_to_float(0x10000, &all[0], HALF_BF16, &widened[0]);
+    for (int i = 0; i < 0x10000; ++i) {
+      const uint32_t bits = static_cast<uint32_t>(i) << 16;
+      EXPECT_EQ(memcmp(&widened[i], &bits, sizeof(bits)), 0) << name;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -133,6 +133,31 @@ TYPED_TEST(CropLayerTest, TestCropAll) {
   }
 }
 
+TYPED_TEST(CropLayerTest, TestCropNumIsView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  this->blob_bottom_1_->Reshape(1, 4, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Cropping whole items along num is contiguous, so the top is a view.
+  EXPECT_EQ(this->blob_top_->cpu_data(),
+      this->blob_bottom_0_->cpu_data() + this->blob_bottom_0_->offset(1));
+  for (int c = 0; c < this->blob_top_->channels(); ++c) {
+    for (int h = 0; h < this->blob_top_->height(); ++h) {
+      for (int w = 0; w < this->blob_top_->width(); ++w) {
+        EXPECT_EQ(this->blob_top_->data_at(0, c, h, w),
+            this->blob_bottom_0_->data_at(1, c, h, w));
+      }
+    }
+  }
+}
+
 TYPED_TEST(CropLayerTest, TestCropAllOffset) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -248,6 +273,21 @@ TYPED_TEST(CropLayerTest, TestCropAllGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(CropLayerTest, TestCropNumGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  this->blob_bottom_1_->Reshape(1, 4, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
 TYPED_TEST(CropLayerTest, TestCropHWGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
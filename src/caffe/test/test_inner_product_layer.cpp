@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -239,6 +241,99 @@ TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardNativeGemm) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_nobatch_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    for (int batch = 0; batch <= 1; ++batch) {
+      vector<Blob<Dtype>*> bottom_vec(1,
+          batch ? this->blob_bottom_ : this->blob_bottom_nobatch_);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->set_native_gemm(false);
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(bottom_vec, this->blob_top_vec_);
+      inner_product_param->set_native_gemm(true);
+      InnerProductLayer<Dtype> native_layer(layer_param);
+      Blob<Dtype> native_top;
+      vector<Blob<Dtype>*> native_top_vec(1, &native_top);
+      native_layer.SetUp(bottom_vec, native_top_vec);
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        native_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+      }
+      // The second pass checks that changed weights are packed again.
+      for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+          Blob<Dtype>* weights = layer.blobs()[0].get();
+          caffe_scal(weights->count(), Dtype(-2), weights->mutable_cpu_data());
+          native_layer.blobs()[0]->CopyFrom(*weights);
+        }
+        layer.Forward(bottom_vec, this->blob_top_vec_);
+        native_layer.Forward(bottom_vec, native_top_vec);
+        ASSERT_EQ(native_top.count(), this->blob_top_->count());
+        for (int i = 0; i < native_top.count(); ++i) {
+          EXPECT_NEAR(native_top.cpu_data()[i],
+              this->blob_top_->cpu_data()[i], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfPrecision) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 16-bit weights are for the CPU forward of float nets.
+  if (Caffe::mode() != Caffe::CPU || sizeof(Dtype) != 4) { return; }
+  vector<Blob<Dtype>*> bottom_vec(1, this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  const Precision precisions[] = {FLOAT16, BFLOAT16};
+  for (int p = 0; p < 2; ++p) {
+    layer_param.set_weight_precision(precisions[p]);
+    InnerProductLayer<Dtype> half_layer(layer_param);
+    Blob<Dtype> half_top;
+    vector<Blob<Dtype>*> half_top_vec(1, &half_top);
+    half_layer.SetUp(bottom_vec, half_top_vec);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      half_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    half_layer.Forward(bottom_vec, half_top_vec);
+    // The reference runs on the weights rounded the same way.
+    const HalfFormat format = precisions[p] == FLOAT16 ? HALF_FP16 : HALF_BF16;
+    Blob<Dtype> weights;
+    weights.CopyFrom(*half_layer.blobs()[0], false, true);
+    Dtype* weight_data = layer.blobs()[0]->mutable_cpu_data();
+    for (int i = 0; i < weights.count(); ++i) {
+      const float weight = weights.cpu_data()[i];
+      uint16_t half;
+      float widened;
+      cpu_float_to_half(1, &weight, format, &half);
+      cpu_half_to_float(1, &half, format, &widened);
+      weight_data[i] = widened;
+    }
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    layer.blobs()[0]->CopyFrom(weights);
+    ASSERT_EQ(half_top.count(), this->blob_top_->count());
+    for (int i = 0; i < half_top.count(); ++i) {
+      EXPECT_NEAR(half_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
@@ -8,8 +8,10 @@
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -1297,6 +1299,125 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromMapped) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kBiasTerm = true;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet(NULL, NULL, false, kBiasTerm);
+  shared_ptr<Net<Dtype> > trained = this->net_;
+  NetParameter trained_param;
+  trained->ToProto(&trained_param);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffemap";
+  WriteMappedWeights(trained_param, filename);
+
+  // A differently initialized net takes on the mapped weights.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet(NULL, NULL, false, kBiasTerm);
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  const vector<Blob<Dtype>*>& trained_params = trained->learnable_params();
+  ASSERT_EQ(params.size(), 4);
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_TRUE(params[i]->shape() == trained_params[i]->shape());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      // The file holds floats.
+      EXPECT_EQ(params[i]->cpu_data()[j],
+          static_cast<float>(trained_params[i]->cpu_data()[j]));
+    }
+  }
+  // Writing to the weights leaves the file alone.
+  caffe_set(params[0]->count(), Dtype(0), params[0]->mutable_cpu_data());
+  MappedWeights mapped(filename);
+  ASSERT_EQ(mapped.index().layer_size(), 2);
+  EXPECT_EQ(mapped.index().layer(0).name(), "innerproduct1");
+  const float* mapped_data = mapped.data(mapped.index().layer(0).blobs(0));
+  for (int j = 0; j < params[0]->count(); ++j) {
+    EXPECT_EQ(mapped_data[j], static_cast<float>(
+        trained_params[0]->cpu_data()[j]));
+  }
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromParallel) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  shared_ptr<Net<Dtype> > trained = this->net_;
+  NetParameter trained_param;
+  trained->ToProto(&trained_param);
+  // The shared weights are listed under both layers but copied once.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDiffDataSharedWeightsNet();
+  Caffe::set_num_threads(4);
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  Caffe::set_num_threads(1);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(params.size(), trained->params().size());
+  for (int i = 0; i < params.size(); ++i) {
+    const Blob<Dtype>* trained_blob = trained->params()[i].get();
+    ASSERT_EQ(params[i]->count(), trained_blob->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], trained_blob->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersLazily) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'LazyNetwork' "
+      "state { phase: TEST } "
+      "lazy_weights: true "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  shared_ptr<Net<Dtype> > trained = this->net_;
+  NetParameter trained_param;
+  trained->ToProto(&trained_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(trained_param, filename);
+
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitNetFromProtoString(proto);
+  EXPECT_TRUE(this->net_->lazy_weights());
+  shared_ptr<Net<Dtype> > clone = this->net_->CloneForInference();
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  const vector<shared_ptr<Blob<Dtype> > >& trained_params = trained->params();
+  ASSERT_EQ(params.size(), 4);
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_NE(params[i]->cpu_data()[0], trained_params[i]->cpu_data()[0]);
+  }
+  // Running the convolution on the clone copies its weights and bias only.
+  clone->ForwardTo(1);
+  for (int i = 0; i < params.size(); ++i) {
+    if (i < 2) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(params[i]->cpu_data()[j], trained_params[i]->cpu_data()[j]);
+      }
+    } else {
+      EXPECT_NE(params[i]->cpu_data()[0], trained_params[i]->cpu_data()[0]);
+    }
+  }
+  this->net_->Forward();
+  for (int i = 2; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], trained_params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -2446,6 +2567,228 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestFuseActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'FusedNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prelu1' type: 'PReLU' bottom: 'conv1' top: 'conv1' "
+      "  prelu_param { filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2' "
+      "  convolution_param { num_output: 2 kernel_size: 1 bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' "
+      "  relu_param { negative_slope: 0.1 } } ";
+  // A TRAIN net is not fused and serves as the reference.
+  this->InitNetFromProtoString(proto + "state { phase: TRAIN }");
+  shared_ptr<Net<Dtype> > reference = this->net_;
+  this->InitNetFromProtoString(proto + "state { phase: TEST }");
+  this->net_->ShareTrainedLayersWith(reference.get());
+  EXPECT_TRUE(dynamic_cast<ConvolutionLayer<Dtype>*>(
+      this->net_->layer_by_name("conv1").get())->has_fused_activation());
+  EXPECT_TRUE(dynamic_cast<ConvolutionLayer<Dtype>*>(
+      this->net_->layer_by_name("conv2").get())->has_fused_activation());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(reference->input_blobs()[0]);
+  this->net_->input_blobs()[0]->CopyFrom(*reference->input_blobs()[0]);
+  reference->Forward();
+  this->net_->Forward();
+  const Blob<Dtype>* expected = reference->output_blobs()[0];
+  const Blob<Dtype>* actual = this->net_->output_blobs()[0];
+  ASSERT_EQ(actual->count(), expected->count());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(actual->cpu_data()[i], expected->cpu_data()[i], 1e-5);
+  }
+}
+
+TYPED_TEST(NetTest, TestBlockedLayout) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The blocked layout is for the CPU only.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // A trunk like the MTCNN nets with a concatenation of partial blocks, a
+  // sum and two heads, one of which goes on in the plain layout.
+  const string& proto =
+      "name: 'BlockedNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 12 dim: 12 } } } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { num_output: 10 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prelu1' type: 'PReLU' bottom: 'conv1' top: 'conv1' "
+      "  prelu_param { filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 3 stride: 2 } } "
+      "layer { name: 'conv2a' type: 'Convolution' bottom: 'pool1' "
+      "  top: 'conv2a' convolution_param { num_output: 13 kernel_size: 3 "
+      "    pad: 1 weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'relu2a' type: 'ReLU' bottom: 'conv2a' top: 'conv2a' } "
+      "layer { name: 'conv2b' type: 'Convolution' bottom: 'pool1' "
+      "  top: 'conv2b' convolution_param { num_output: 6 kernel_size: 3 "
+      "    pad: 1 weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'conv2a' "
+      "  bottom: 'conv2b' top: 'concat' } "
+      "layer { name: 'conv3a' type: 'Convolution' bottom: 'concat' "
+      "  top: 'conv3a' convolution_param { num_output: 8 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'conv3b' type: 'Convolution' bottom: 'concat' "
+      "  top: 'conv3b' convolution_param { num_output: 8 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'conv3a' bottom: 'conv3b' "
+      "  top: 'sum' } "
+      "layer { name: 'pool2' type: 'Pooling' bottom: 'sum' top: 'pool2' "
+      "  pooling_param { pool: AVE kernel_size: 2 stride: 1 } } "
+      "layer { name: 'conv4-1' type: 'Convolution' bottom: 'pool2' "
+      "  top: 'conv4-1' convolution_param { num_output: 2 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prob' type: 'Softmax' bottom: 'conv4-1' top: 'prob' } "
+      "layer { name: 'conv4-2' type: 'Convolution' bottom: 'pool2' "
+      "  top: 'conv4-2' convolution_param { num_output: 4 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } ";
+  this->InitNetFromProtoString(proto);
+  shared_ptr<Net<Dtype> > reference = this->net_;
+  this->InitNetFromProtoString(proto + "blocked_layout: true");
+  this->net_->ShareTrainedLayersWith(reference.get());
+  EXPECT_TRUE(this->net_->has_layer("data_to_nchw8c"));
+  EXPECT_TRUE(this->net_->has_layer("conv4-1_to_nchw"));
+  EXPECT_EQ(this->net_->blob_by_name("conv1_nchw8c")->blocked_channels(), 10);
+  EXPECT_EQ(this->net_->blob_by_name("concat_nchw8c")->blocked_channels(),
+      19);
+  EXPECT_EQ(this->net_->blob_by_name("pool2_nchw8c")->blocked_channels(), 8);
+  EXPECT_TRUE(dynamic_cast<ConvolutionLayer<Dtype>*>(
+      this->net_->layer_by_name("conv1").get())->has_fused_activation());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(reference->input_blobs()[0]);
+  this->net_->input_blobs()[0]->CopyFrom(*reference->input_blobs()[0]);
+  reference->Forward();
+  this->net_->Forward();
+  const char* outputs[] = {"prob", "conv4-2"};
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* expected = reference->blob_by_name(outputs[i]).get();
+    const Blob<Dtype>* actual = this->net_->blob_by_name(outputs[i]).get();
+    EXPECT_EQ(actual->blocked_channels(), 0);
+    ASSERT_TRUE(actual->shape() == expected->shape());
+    for (int j = 0; j < expected->count(); ++j) {
+      EXPECT_NEAR(actual->cpu_data()[j], expected->cpu_data()[j], 1e-4)
+          << outputs[i];
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCloneForInference) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'CloneNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prelu' type: 'PReLU' bottom: 'conv' top: 'conv' "
+      "  prelu_param { filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prob' type: 'Softmax' bottom: 'ip' top: 'prob' } ";
+  this->InitNetFromProtoString(proto);
+  shared_ptr<Net<Dtype> > clone = this->net_->CloneForInference();
+  // The clone uses the same parameters but has activations of its own.
+  ASSERT_EQ(clone->params().size(), this->net_->params().size());
+  for (int i = 0; i < clone->params().size(); ++i) {
+    EXPECT_EQ(clone->params()[i].get(), this->net_->params()[i].get());
+  }
+  ASSERT_EQ(clone->blobs().size(), this->net_->blobs().size());
+  for (int i = 0; i < clone->blobs().size(); ++i) {
+    EXPECT_NE(clone->blobs()[i]->cpu_data(),
+        this->net_->blobs()[i]->cpu_data());
+  }
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  clone->input_blobs()[0]->CopyFrom(*this->net_->input_blobs()[0]);
+  clone->Forward();
+  this->net_->Forward();
+  const Blob<Dtype>* expected = this->net_->output_blobs()[0];
+  const Blob<Dtype>* actual = clone->output_blobs()[0];
+  ASSERT_EQ(actual->count(), expected->count());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_EQ(actual->cpu_data()[i], expected->cpu_data()[i]);
+  }
+  // Running the original on other data leaves the clone's output alone.
+  Blob<Dtype> clone_output;
+  clone_output.CopyFrom(*actual, false, true);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  for (int i = 0; i < actual->count(); ++i) {
+    EXPECT_EQ(actual->cpu_data()[i], clone_output.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestParallelForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Three heads read the shared trunk; one of them has an in-place layer,
+  // and two are joined again.
+  const string& proto =
+      "name: 'ParallelNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prelu' type: 'PReLU' bottom: 'conv' top: 'conv' "
+      "  prelu_param { filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'conv' top: 'ip1' "
+      "  inner_product_param { num_output: 2 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'prob' type: 'Softmax' bottom: 'ip1' top: 'prob' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'conv' top: 'ip2' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip2' top: 'ip2' } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'conv' top: 'ip3' "
+      "  inner_product_param { num_output: 10 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'ip2' bottom: 'ip3' "
+      "  top: 'concat' } ";
+  this->InitNetFromProtoString(proto);
+  EXPECT_FALSE(this->net_->parallel_forward());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  vector<shared_ptr<Blob<Dtype> > > expected;
+  for (int i = 0; i < this->net_->output_blobs().size(); ++i) {
+    expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected[i]->CopyFrom(*this->net_->output_blobs()[i], false, true);
+  }
+  Caffe::set_num_threads(4);
+  this->net_->set_parallel_forward(true);
+  for (int pass = 0; pass < 3; ++pass) {
+    this->net_->Forward();
+    for (int i = 0; i < expected.size(); ++i) {
+      const Blob<Dtype>* actual = this->net_->output_blobs()[i];
+      ASSERT_EQ(actual->count(), expected[i]->count());
+      for (int j = 0; j < actual->count(); ++j) {
+        EXPECT_EQ(actual->cpu_data()[j], expected[i]->cpu_data()[j]);
+      }
+    }
+  }
+  Caffe::set_num_threads(1);
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
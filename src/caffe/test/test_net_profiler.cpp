@@ -0,0 +1,106 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/net_profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class NetProfilerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // The ReLU is fused into the convolution, so it never runs on its own.
+  NetProfilerTest() {
+    const string proto =
+        "name: 'ProfiledNetwork' "
+        "state { phase: TEST } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { num_output: 4 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  static int Count(const string& text, const string& pattern) {
+    int count = 0;
+    for (size_t pos = text.find(pattern); pos != string::npos;
+         pos = text.find(pattern, pos + 1)) {
+      ++count;
+    }
+    return count;
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(NetProfilerTest, TestDtypes);
+
+TYPED_TEST(NetProfilerTest, TestLayerStats) {
+  typedef NetProfiler<TypeParam> Profiler;
+  const int kSamplePeriod = 2;
+  Profiler profiler(this->net_.get(), kSamplePeriod);
+  EXPECT_EQ(this->net_->before_forward().size(), 1);
+  EXPECT_EQ(this->net_->after_forward().size(), 1);
+  for (int i = 0; i < 5; ++i) {
+    this->net_->Forward();
+  }
+  const vector<typename Profiler::LayerStats>& stats = profiler.layer_stats();
+  ASSERT_EQ(stats.size(), 4);
+  const int kCalls[] = {3, 3, 0, 3};
+  for (int i = 0; i < stats.size(); ++i) {
+    EXPECT_EQ(stats[i].calls, kCalls[i]);
+    int64_t histogram_calls = 0;
+    for (int b = 0; b < stats[i].histogram.size(); ++b) {
+      histogram_calls += stats[i].histogram[b];
+    }
+    EXPECT_EQ(histogram_calls, stats[i].calls);
+    EXPECT_LE(stats[i].min_us, stats[i].max_us);
+  }
+  // Multiply-adds of 3 x 3 x 3 weights for each of the 2 x 4 x 3 x 3
+  // outputs, and of 36 weights for each of the 2 x 3 outputs.
+  EXPECT_EQ(stats[1].flops, 3 * 2 * 27 * 72);
+  EXPECT_EQ(stats[3].flops, 3 * 2 * 36 * 6);
+  EXPECT_EQ(stats[3].bytes, 3 * (72 + 6 + 108 + 3) * sizeof(TypeParam));
+  profiler.Reset();
+  EXPECT_EQ(profiler.layer_stats()[1].calls, 0);
+}
+
+TYPED_TEST(NetProfilerTest, TestChromeTrace) {
+  {
+    NetProfiler<TypeParam> profiler(this->net_.get());
+    this->net_->Forward();
+    this->net_->Forward();
+    std::ostringstream trace;
+    profiler.WriteChromeTrace(&trace);
+    EXPECT_EQ(trace.str().find("{\"traceEvents\":["), 0);
+    EXPECT_EQ(this->Count(trace.str(), "\"ph\":\"X\""), 6);
+    EXPECT_EQ(this->Count(trace.str(), "\"name\":\"conv\""), 2);
+    EXPECT_EQ(this->Count(trace.str(), "\"name\":\"relu\""), 0);
+    std::ostringstream histograms;
+    profiler.WriteHistograms(&histograms);
+    EXPECT_EQ(this->Count(histograms.str(), "\"histogram_us\":["), 4);
+    EXPECT_EQ(this->Count(histograms.str(), "\"calls\":2"), 3);
+  }
+  // The profiler detaches when it goes away.
+  EXPECT_EQ(this->net_->before_forward().size(), 0);
+  EXPECT_EQ(this->net_->after_forward().size(), 0);
+  this->net_->Forward();
+}
+
+}  // namespace caffe
@@ -730,6 +730,23 @@ TYPED_TEST(NeuronLayerTest, TestPReLUConsistencyReLU) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestPReLUInPlaceForwardOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Forward only layers skip saving the input, with the same result.
+  LayerParameter layer_param;
+  layer_param.mutable_prelu_param()->mutable_filler()->set_type("gaussian");
+  PReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.set_forward_only(true);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestPReLUInPlace) {
   typedef typename TypeParam::Dtype Dtype;
   // Set layer parameters
@@ -0,0 +1,176 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/optimize_net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class OptimizeNetTest : public ::testing::Test {
+ protected:
+  void RunOptimizeTest(
+      const string& input_param_string, const string& output_param_string) {
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    OptimizeNetForInference(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+  }
+};
+
+TEST_F(OptimizeNetTest, TestRemovePassThrough) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'split' type: 'Split' bottom: 'data' "
+      "  top: 'data_a' top: 'data_b' } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'data_a' top: 'dropped' } "
+      "layer { name: 'drop_in_place' type: 'Dropout' bottom: 'data_b' "
+      "  top: 'data_b' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'dropped' "
+      "  bottom: 'data_b' top: 'sum' } "
+      "layer { name: 'drop_out' type: 'Dropout' bottom: 'sum' top: 'out' } ";
+  // The last Dropout produces a net output, which keeps its name.
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'data' "
+      "  bottom: 'data' top: 'sum' } "
+      "layer { name: 'drop_out' type: 'Dropout' bottom: 'sum' top: 'out' } ";
+  this->RunOptimizeTest(input_proto, expected_output_proto);
+}
+
+TEST_F(OptimizeNetTest, TestKeepDropoutOfRewrittenBlob) {
+  // relu changes data in place while the copy made by drop is still to be
+  // read, so drop has to stay.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'data' top: 'copy' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'data' top: 'data' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'copy' "
+      "  bottom: 'data' top: 'sum' } ";
+  this->RunOptimizeTest(input_proto, input_proto);
+}
+
+TEST_F(OptimizeNetTest, TestKeepDropoutOfCopyRewrittenInPlace) {
+  // relu changes the copy in place while data is still to be read, so
+  // without drop relu would change data too.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'data' top: 'copy' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'copy' top: 'copy' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'copy' "
+      "  bottom: 'data' top: 'sum' } ";
+  this->RunOptimizeTest(input_proto, input_proto);
+}
+
+TEST_F(OptimizeNetTest, TestKeepSplitOfTopRewrittenInPlace) {
+  // relu changes one top of split in place while the other is still to be
+  // read.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'split' type: 'Split' bottom: 'data' "
+      "  top: 'split0' top: 'split1' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'split0' top: 'split0' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'split0' "
+      "  bottom: 'split1' top: 'sum' } ";
+  this->RunOptimizeTest(input_proto, input_proto);
+}
+
+template <typename Dtype>
+class OptimizeNetFoldTest : public CPUDeviceTest<Dtype> {
+ protected:
+  void InitNet() {
+    const string& proto =
+        "name: 'FoldTestNetwork' "
+        "state { phase: TEST } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 4 kernel_size: 3 bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv' "
+        "  scale_param { bias_term: true } } "
+        "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'ip_bn' type: 'BatchNorm' bottom: 'ip' top: 'ip_bn' } "
+        "layer { name: 'drop' type: 'Dropout' bottom: 'ip_bn' top: 'drop' } "
+        "layer { name: 'prob' type: 'Softmax' bottom: 'drop' top: 'prob' } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+    // Give the normalization layers non-trivial statistics.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> gaussian(filler_param);
+    filler_param.set_min(0.5);
+    filler_param.set_max(1.5);
+    UniformFiller<Dtype> uniform(filler_param);
+    const char* bn_names[] = {"bn", "ip_bn"};
+    for (int i = 0; i < 2; ++i) {
+      vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net_->layer_by_name(bn_names[i])->blobs();
+      gaussian.Fill(blobs[0].get());
+      uniform.Fill(blobs[1].get());
+      blobs[2]->mutable_cpu_data()[0] = 2;
+    }
+    vector<shared_ptr<Blob<Dtype> > >& scale_blobs =
+        net_->layer_by_name("scale")->blobs();
+    uniform.Fill(scale_blobs[0].get());
+    gaussian.Fill(scale_blobs[1].get());
+    gaussian.Fill(net_->input_blobs()[0]);
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(OptimizeNetFoldTest, TestDtypes);
+
+TYPED_TEST(OptimizeNetFoldTest, TestFoldBatchNormScale) {
+  this->InitNet();
+  this->net_->Forward();
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param, false);
+  NetParameter optimized_param;
+  OptimizeNetForInference(trained_param, &optimized_param);
+  ASSERT_EQ(optimized_param.layer_size(), 5);
+  EXPECT_EQ(optimized_param.layer(1).type(), "Convolution");
+  EXPECT_TRUE(optimized_param.layer(1).convolution_param().bias_term());
+  EXPECT_EQ(optimized_param.layer(2).type(), "ReLU");
+  EXPECT_EQ(optimized_param.layer(3).type(), "InnerProduct");
+  EXPECT_EQ(optimized_param.layer(3).top(0), "ip_bn");
+  EXPECT_EQ(optimized_param.layer(4).bottom(0), "ip_bn");
+  // The optimized net carries its weights and computes the same output.
+  optimized_param.mutable_state()->set_phase(TEST);
+  Net<TypeParam> optimized_net(optimized_param);
+  optimized_net.input_blobs()[0]->CopyFrom(*this->net_->input_blobs()[0]);
+  optimized_net.Forward();
+  const Blob<TypeParam>* expected = this->net_->blob_by_name("prob").get();
+  const Blob<TypeParam>* actual = optimized_net.blob_by_name("prob").get();
+  ASSERT_EQ(actual->count(), expected->count());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(actual->cpu_data()[i], expected->cpu_data()[i], 1e-5);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,110 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/packed_weights.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PackedWeightsTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Two groups of 10 x 6 matrices.
+  PackedWeightsTest() : weights_(2, 10, 6, 1) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&weights_);
+  }
+
+  // The packed element for row r and column c of group g.
+  static Dtype Packed(const PackedWeights<Dtype>& packed, int g, int r,
+      int c) {
+    vector<Dtype> buffer;
+    return packed.panel(g, r / kGemmPanelRows, &buffer)
+        [c * kGemmPanelRows + r % kGemmPanelRows];
+  }
+
+  Blob<Dtype> weights_;
+};
+
+TYPED_TEST_CASE(PackedWeightsTest, TestDtypes);
+
+TYPED_TEST(PackedWeightsTest, TestPack) {
+  PackedWeights<TypeParam> packed;
+  packed.Update(this->weights_, 2, 10, 6);
+  const TypeParam* data = this->weights_.cpu_data();
+  for (int g = 0; g < 2; ++g) {
+    for (int r = 0; r < 10; ++r) {
+      for (int c = 0; c < 6; ++c) {
+        EXPECT_EQ(this->Packed(packed, g, r, c), data[(g * 10 + r) * 6 + c]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PackedWeightsTest, TestShareAcrossUsers) {
+  PackedWeights<TypeParam> packed;
+  PackedWeights<TypeParam> other;
+  packed.Update(this->weights_, 2, 10, 6);
+  other.Update(this->weights_, 2, 10, 6);
+  vector<TypeParam> buffer;
+  EXPECT_EQ(packed.panel(0, 0, &buffer), other.panel(0, 0, &buffer));
+  // New weights are packed again, once.
+  this->weights_.mutable_cpu_data()[0] = 2;
+  packed.Update(this->weights_, 2, 10, 6);
+  EXPECT_EQ(this->Packed(packed, 0, 0, 0), 2);
+  EXPECT_NE(packed.panel(0, 0, &buffer), other.panel(0, 0, &buffer));
+  other.Update(this->weights_, 2, 10, 6);
+  EXPECT_EQ(packed.panel(0, 0, &buffer), other.panel(0, 0, &buffer));
+  // Another layout is a packing of its own.
+  other.Update(this->weights_, 1, 20, 6);
+  EXPECT_NE(packed.panel(0, 0, &buffer), other.panel(0, 0, &buffer));
+  EXPECT_EQ(this->Packed(other, 0, 12, 3),
+      this->weights_.cpu_data()[12 * 6 + 3]);
+}
+
+TYPED_TEST(PackedWeightsTest, TestReleaseWeights) {
+  // 16-bit weights are for float nets.
+  if (sizeof(TypeParam) != 4) { return; }
+  // Weights shared with another blob stay.
+  Blob<TypeParam> shared;
+  shared.ReshapeLike(this->weights_);
+  shared.ShareData(this->weights_);
+  Blob<TypeParam> original;
+  original.CopyFrom(this->weights_, false, true);
+  PackedWeights<TypeParam> packed;
+  packed.set_release_weights(true);
+  packed.Update(this->weights_, 2, 10, 6, true, FLOAT16);
+  for (int i = 0; i < original.count(); ++i) {
+    EXPECT_EQ(this->weights_.cpu_data()[i], original.cpu_data()[i]);
+  }
+  // Otherwise they are freed, and reads get the rounded packed copy back.
+  shared.ShareData(original);
+  this->weights_.mutable_cpu_data();
+  const int version = this->weights_.data()->version();
+  packed.Update(this->weights_, 2, 10, 6, true, FLOAT16);
+  EXPECT_EQ(this->weights_.data()->version(), version);
+  const TypeParam* data = this->weights_.cpu_data();
+  int rounded = 0;
+  for (int g = 0; g < 2; ++g) {
+    for (int r = 0; r < 10; ++r) {
+      for (int c = 0; c < 6; ++c) {
+        const int i = (g * 6 + c) * 10 + r;
+        EXPECT_EQ(data[i], this->Packed(packed, g, r, c));
+        EXPECT_NEAR(data[i], original.cpu_data()[i], 1e-2);
+        rounded += data[i] != original.cpu_data()[i];
+      }
+    }
+  }
+  EXPECT_GT(rounded, 0);
+  // Reading them does not count as a change.
+  packed.Update(this->weights_, 2, 10, 6, true, FLOAT16);
+  EXPECT_EQ(this->weights_.data()->version(), version);
+}
+
+}  // namespace caffe
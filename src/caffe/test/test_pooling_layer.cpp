@@ -609,6 +609,39 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Pooling without a mask gives the same outputs, including those of the
+  // windows clipped at the bottom and right edges.
+  this->blob_bottom_->Reshape(2, 3, 12, 23);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> expected;
+  for (int kernel = 2; kernel <= 3; ++kernel) {
+    for (int ave = 0; ave <= 1; ++ave) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_size(kernel);
+      pooling_param->set_stride(2);
+      pooling_param->set_pool(ave ? PoolingParameter_PoolMethod_AVE :
+          PoolingParameter_PoolMethod_MAX);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      expected.CopyFrom(*this->blob_top_, false, true);
+      layer.set_forward_only(true);
+      caffe_set(this->blob_top_->count(), Dtype(0),
+          this->blob_top_->mutable_cpu_data());
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < expected.count(); ++i) {
+        EXPECT_NEAR(this->blob_top_->cpu_data()[i], expected.cpu_data()[i],
+            1e-6);
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/reorder_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ReorderLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+ protected:
+  // 11 channels fill one block and part of a second.
+  ReorderLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 11, 3, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ReorderLayerTest() { delete blob_bottom_; delete blob_top_; }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ReorderLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ReorderLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(this->blob_top_->num_axes(), 5);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 2);
+  EXPECT_EQ(this->blob_top_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_->shape(3), 4);
+  EXPECT_EQ(this->blob_top_->shape(4), kChannelBlock);
+  EXPECT_EQ(this->blob_top_->blocked_channels(), 11);
+}
+
+TYPED_TEST(ReorderLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 2 * kChannelBlock; ++c) {
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 4; ++w) {
+          vector<int> index(1, n);
+          index.push_back(c / kChannelBlock);
+          index.push_back(h);
+          index.push_back(w);
+          index.push_back(c % kChannelBlock);
+          const Dtype expected = c < 11 ?
+              this->blob_bottom_->data_at(n, c, h, w) : Dtype(0);
+          EXPECT_EQ(this->blob_top_->data_at(index), expected);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestRoundTrip) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReorderLayer<Dtype> to_blocked(layer_param);
+  layer_param.mutable_reorder_param()->set_layout(
+      ReorderParameter_Layout_NCHW);
+  ReorderLayer<Dtype> to_plain(layer_param);
+  Blob<Dtype> plain;
+  vector<Blob<Dtype>*> plain_vec(1, &plain);
+  to_blocked.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  to_blocked.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  to_plain.SetUp(this->blob_top_vec_, plain_vec);
+  to_plain.Forward(this->blob_top_vec_, plain_vec);
+  EXPECT_EQ(plain.blocked_channels(), 0);
+  ASSERT_TRUE(plain.shape() == this->blob_bottom_->shape());
+  for (int i = 0; i < plain.count(); ++i) {
+    EXPECT_EQ(plain.cpu_data()[i], this->blob_bottom_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReorderLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -132,6 +132,27 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumIsView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.mutable_slice_param()->add_slice_point(1);
+  layer_param.mutable_slice_param()->add_slice_point(4);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_1_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_1_);
+  // The tops are ranges of the bottom rather than copies.
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  EXPECT_EQ(this->blob_top_0_->cpu_data(), bottom_data);
+  EXPECT_EQ(this->blob_top_1_->cpu_data(),
+            bottom_data + this->blob_bottom_->offset(1));
+  EXPECT_EQ(this->blob_top_2_->cpu_data(),
+            bottom_data + this->blob_bottom_->offset(4));
+  EXPECT_EQ(this->blob_top_2_->num(), 2);
+  EXPECT_EQ(this->blob_bottom_->data_at(5, 11, 1, 2),
+            this->blob_top_2_->data_at(1, 11, 1, 2));
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -74,6 +75,49 @@ TYPED_TEST(SoftmaxLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardShapes) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two classes, contiguous channels (inner size 1) and wide inner sizes
+  // take different paths; check each against the definition, with inputs
+  // spread wide enough that some probabilities are tiny.
+  const int shapes[][4] = {{2, 2, 5, 7}, {3, 1, 1, 1}, {2, 10, 9, 11}};
+  const int channels[] = {2, 37, 10};
+  for (int s = 0; s < 3; ++s) {
+    vector<int> shape(shapes[s], shapes[s] + 4);
+    shape[1] = channels[s];
+    this->blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    filler_param.set_std(5);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    LayerParameter layer_param;
+    SoftmaxLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int inner = this->blob_bottom_->count(2);
+    for (int i = 0; i < shape[0]; ++i) {
+      for (int k = 0; k < inner; ++k) {
+        const Dtype* bottom = this->blob_bottom_->cpu_data() +
+            i * shape[1] * inner + k;
+        const Dtype* top = this->blob_top_->cpu_data() +
+            i * shape[1] * inner + k;
+        double max_value = bottom[0];
+        for (int j = 1; j < shape[1]; ++j) {
+          max_value = std::max<double>(max_value, bottom[j * inner]);
+        }
+        double sum = 0;
+        for (int j = 0; j < shape[1]; ++j) {
+          sum += exp(bottom[j * inner] - max_value);
+        }
+        for (int j = 0; j < shape[1]; ++j) {
+          const double expected = exp(bottom[j * inner] - max_value) / sum;
+          EXPECT_NEAR(top[j * inner], expected, 1e-6 + 1e-5 * expected);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(SoftmaxLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
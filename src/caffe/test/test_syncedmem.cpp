@@ -22,6 +22,43 @@ TEST_F(SyncedMemoryTest, TestInitialization) {
   delete p_mem;
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const int version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), version);
+  mem.mutable_cpu_data();
+  EXPECT_EQ(mem.version(), version + 1);
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_EQ(mem.version(), version + 2);
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), version + 2);
+}
+
+class FillRestorer : public SyncedMemory::Restorer {
+ public:
+  virtual void Restore(void* data) const {
+    caffe_memset(10, 7, data);
+  }
+};
+
+TEST_F(SyncedMemoryTest, TestReleaseCPUData) {
+  SyncedMemory mem(10);
+  caffe_memset(10, 1, mem.mutable_cpu_data());
+  const int version = mem.version();
+  mem.release_cpu_data(shared_ptr<FillRestorer>(new FillRestorer()));
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(data[i], 7);
+  }
+  EXPECT_EQ(mem.version(), version);
+  // Restored data is the data until the memory is released again.
+  static_cast<char*>(mem.mutable_cpu_data())[0] = 1;
+  EXPECT_EQ(static_cast<const char*>(mem.cpu_data())[0], 1);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestAllocationCPUGPU) {
@@ -0,0 +1,182 @@
+#include <boost/bind.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/layers/softmax_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  // Count how often each index is visited and remember the chunks.
+  void Visit(int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      ++visits_[i];
+    }
+    chunk_sizes_[begin] = end - begin;
+  }
+
+  // Issue a ParallelFor from inside the body of another one.
+  void VisitNested(ThreadPool* pool, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      pool->ParallelFor(i * 10, (i + 1) * 10, 1,
+          boost::bind(&ThreadPoolTest::Visit, this, _1, _2));
+    }
+  }
+
+ protected:
+  void Reset(int count) {
+    visits_.assign(count, 0);
+    chunk_sizes_.assign(count, 0);
+  }
+
+  vector<int> visits_;
+  vector<int> chunk_sizes_;
+};
+
+TEST_F(ThreadPoolTest, TestCoversRange) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  this->Reset(1003);
+  pool.ParallelFor(3, 1003, 10,
+      boost::bind(&ThreadPoolTest::Visit, this, _1, _2));
+  int num_chunks = 0;
+  for (int i = 0; i < 1003; ++i) {
+    EXPECT_EQ(this->visits_[i], i < 3 ? 0 : 1);
+    if (this->chunk_sizes_[i]) {
+      EXPECT_GE(this->chunk_sizes_[i], 10);
+      ++num_chunks;
+    }
+  }
+  EXPECT_EQ(num_chunks, 4);
+}
+
+TEST_F(ThreadPoolTest, TestGrain) {
+  // Fewer than two grains of work is not split.
+  ThreadPool pool(4);
+  this->Reset(30);
+  pool.ParallelFor(0, 30, 16,
+      boost::bind(&ThreadPoolTest::Visit, this, _1, _2));
+  EXPECT_EQ(this->chunk_sizes_[0], 30);
+  this->Reset(30);
+  pool.ParallelFor(0, 30, 10,
+      boost::bind(&ThreadPoolTest::Visit, this, _1, _2));
+  EXPECT_EQ(this->chunk_sizes_[0], 10);
+  EXPECT_EQ(this->chunk_sizes_[10], 10);
+  EXPECT_EQ(this->chunk_sizes_[20], 10);
+}
+
+TEST_F(ThreadPoolTest, TestNestedRunsSerially) {
+  ThreadPool pool(4);
+  this->Reset(40);
+  pool.ParallelFor(0, 4, 1,
+      boost::bind(&ThreadPoolTest::VisitNested, this, &pool, _1, _2));
+  for (int i = 0; i < 40; ++i) {
+    EXPECT_EQ(this->visits_[i], 1);
+    // Each inner loop ran as a single chunk.
+    EXPECT_EQ(this->chunk_sizes_[i], i % 10 ? 0 : 10);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestElementwise) {
+  // Large enough to be split over four threads, with a tail in each chunk.
+  const int count = 200003;
+  Blob<float> a(vector<int>(1, count)), b(vector<int>(1, count));
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&a);
+  filler.Fill(&b);
+  vector<float> serial(count), parallel(count);
+  for (int op = 0; op < 5; ++op) {
+    for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+      Caffe::set_num_threads(num_threads);
+      float* y = num_threads == 1 ? &serial[0] : &parallel[0];
+      switch (op) {
+      case 0: caffe_add(count, a.cpu_data(), b.cpu_data(), y); break;
+      case 1: caffe_sub(count, a.cpu_data(), b.cpu_data(), y); break;
+      case 2: caffe_mul(count, a.cpu_data(), b.cpu_data(), y); break;
+      case 3: caffe_div(count, a.cpu_data(), b.cpu_data(), y); break;
+      case 4: caffe_exp(count, a.cpu_data(), y); break;
+      }
+    }
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(serial[i], parallel[i]) << "op " << op << " at " << i;
+    }
+  }
+  Caffe::set_num_threads(1);
+}
+
+template <typename Dtype>
+class ThreadPoolLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ThreadPoolLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 37, 41)),
+        blob_top_serial_(new Blob<Dtype>()),
+        blob_top_parallel_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+  }
+  virtual ~ThreadPoolLayerTest() {
+    Caffe::set_num_threads(1);
+    delete blob_bottom_;
+    delete blob_top_serial_;
+    delete blob_top_parallel_;
+  }
+
+  // Run the layer single threaded and with four threads and compare.
+  void CheckParallelForward(Layer<Dtype>* layer) {
+    vector<Blob<Dtype>*> top_vec(1, blob_top_serial_);
+    Caffe::set_num_threads(1);
+    layer->SetUp(blob_bottom_vec_, top_vec);
+    layer->Forward(blob_bottom_vec_, top_vec);
+    top_vec[0] = blob_top_parallel_;
+    Caffe::set_num_threads(4);
+    layer->Reshape(blob_bottom_vec_, top_vec);
+    layer->Forward(blob_bottom_vec_, top_vec);
+    ASSERT_EQ(blob_top_serial_->count(), blob_top_parallel_->count());
+    for (int i = 0; i < blob_top_serial_->count(); ++i) {
+      EXPECT_NEAR(blob_top_serial_->cpu_data()[i],
+          blob_top_parallel_->cpu_data()[i], 1e-6);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_serial_;
+  Blob<Dtype>* const blob_top_parallel_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+};
+
+TYPED_TEST_CASE(ThreadPoolLayerTest, TestDtypes);
+
+TYPED_TEST(ThreadPoolLayerTest, TestPooling) {
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  PoolingLayer<TypeParam> max_layer(layer_param);
+  this->CheckParallelForward(&max_layer);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  pooling_param->set_pad(1);
+  PoolingLayer<TypeParam> ave_layer(layer_param);
+  this->CheckParallelForward(&ave_layer);
+}
+
+TYPED_TEST(ThreadPoolLayerTest, TestSoftmax) {
+  LayerParameter layer_param;
+  SoftmaxLayer<TypeParam> layer(layer_param);
+  this->CheckParallelForward(&layer);
+}
+
+}  // namespace caffe
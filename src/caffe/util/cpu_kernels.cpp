@@ -0,0 +1,803 @@
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CAFFE_CPU_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "caffe/util/cpu_kernels.hpp"
+
+#ifdef CAFFE_CPU_DISPATCH
+#define CAFFE_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define CAFFE_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace caffe {
+
+namespace {
+
+// The scalar kernels, which also finish the elements the vector ones leave.
+
+inline float prelu_scalar(float x, float slope) {
+  return std::max(x, 0.f) + slope * std::min(x, 0.f);
+}
+
+// The larger of (x0, x1) gets 1 / (1 + e) and the smaller e / (1 + e), with
+// e = exp(-|x1 - x0|), which needs a single exp and cannot overflow.
+inline void softmax2_scalar(float x0, float x1, float* y0, float* y1) {
+  const float d = x1 - x0;
+  const float e = std::exp(-std::fabs(d));
+  const float larger = 1.f / (1.f + e);
+  const float smaller = e * larger;
+  *y0 = d > 0 ? smaller : larger;
+  *y1 = d > 0 ? larger : smaller;
+}
+
+#define DEFINE_SCALAR_KERNELS(name, operation) \
+  void name##_scalar(int n, const float* a, const float* b, float* y) { \
+    for (int i = 0; i < n; ++i) { operation; } \
+  }
+
+DEFINE_SCALAR_KERNELS(add, y[i] = a[i] + b[i]);
+DEFINE_SCALAR_KERNELS(sub, y[i] = a[i] - b[i]);
+DEFINE_SCALAR_KERNELS(mul, y[i] = a[i] * b[i]);
+DEFINE_SCALAR_KERNELS(div, y[i] = a[i] / b[i]);
+DEFINE_SCALAR_KERNELS(max, y[i] = std::max(a[i], b[i]));
+
+void exp_scalar(int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::exp(x[i]); }
+}
+
+void prelu_scalar(int n, const float* x, float slope, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = prelu_scalar(x[i], slope); }
+}
+
+void softmax2_scalar(int n, const float* x0, const float* x1, float* y0,
+    float* y1) {
+  for (int i = 0; i < n; ++i) {
+    softmax2_scalar(x0[i], x1[i], y0 + i, y1 + i);
+  }
+}
+
+// The 16-bit float conversions work on the bits of the floats.
+
+inline uint32_t float_bits(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+uint16_t float_to_fp16(float value) {
+  uint32_t x = float_bits(value);
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x > 0x7f800000) { return sign | 0x7e00; }  // NaN
+  // 65520 and up round past the largest FP16, 65504.
+  if (x >= 0x477ff000) { return sign | 0x7c00; }
+  if (x >= 0x38800000) {
+    // Normal: move the exponent bias from 127 to 15 and round off 13 bits.
+    x -= 0x38000000;
+    return sign | ((x + 0xfff + ((x >> 13) & 1)) >> 13);
+  }
+  // Half of the smallest subnormal, 2^-24, and below round to zero.
+  if (x <= 0x33000000) { return sign; }
+  // Subnormal: the mantissa in units of 2^-24, rounded by hand.
+  const int shift = 126 - static_cast<int>(x >> 23);
+  const uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+  const uint32_t rest = mantissa & ((1u << shift) - 1);
+  const uint32_t half_way = 1u << (shift - 1);
+  uint16_t h = mantissa >> shift;
+  if (rest > half_way || (rest == half_way && (h & 1))) { ++h; }
+  return sign | h;
+}
+
+float fp16_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  int exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0x1f) {
+    return bits_float(sign | 0x7f800000 | (mantissa << 13));
+  }
+  if (exponent == 0) {
+    if (mantissa == 0) { return bits_float(sign); }
+    // Subnormal: normalize the mantissa.
+    exponent = 1;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    mantissa &= 0x3ff;
+  }
+  return bits_float(sign | static_cast<uint32_t>(exponent + 112) << 23
+      | mantissa << 13);
+}
+
+uint16_t float_to_bf16(float value) {
+  const uint32_t x = float_bits(value);
+  if ((x & 0x7fffffff) > 0x7f800000) { return (x >> 16) | 0x40; }  // NaN
+  return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+void half_to_float_scalar(int n, const uint16_t* x, HalfFormat format,
+    float* y) {
+  if (format == HALF_FP16) {
+    for (int i = 0; i < n; ++i) { y[i] = fp16_to_float(x[i]); }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = bits_float(static_cast<uint32_t>(x[i]) << 16);
+    }
+  }
+}
+
+// The GEMM kernels multiply one packed panel of A by the columns of B and
+// store the first rows of the product. The vector ones finish the columns
+// that do not fill a vector with masked loads, or hand them to
+// gemm_columns_scalar.
+
+void gemm_columns_scalar(int rows, int j, int n, int k, const float* a,
+    const float* b, int ldb, float* c, int ldc) {
+  for (; j < n; ++j) {
+    float sum[kGemmPanelRows] = {0};
+    for (int p = 0; p < k; ++p) {
+      const float bp = b[p * ldb + j];
+      for (int r = 0; r < kGemmPanelRows; ++r) {
+        sum[r] += a[p * kGemmPanelRows + r] * bp;
+      }
+    }
+    for (int r = 0; r < rows; ++r) { c[r * ldc + j] = sum[r]; }
+  }
+}
+
+void gemm_panel_scalar(int rows, int n, int k, const float* a, const float* b,
+    int ldb, float* c, int ldc) {
+  gemm_columns_scalar(rows, 0, n, k, a, b, ldb, c, ldc);
+}
+
+// The blocked convolution kernels compute one output row of one block of
+// output channels. Input channel c of pixel p is input[c / 8 * plane + p * 8
+// + c % 8], and its weights for the block are the 8 floats at
+// ((c * kernel_h + kh) * kernel_w + kw) * 8.
+
+void conv_nchw8c_row_scalar(const BlockedConvShape& s, const float* input,
+    const float* weights, const float* bias, const float* slopes, int oh,
+    float* output) {
+  const int plane = s.height * s.width * kGemmPanelRows;
+  const int ih0 = oh * s.stride_h - s.pad_h;
+  for (int ow = 0; ow < s.output_width; ++ow, output += kGemmPanelRows) {
+    const int iw0 = ow * s.stride_w - s.pad_w;
+    float sum[kGemmPanelRows];
+    std::copy(bias, bias + kGemmPanelRows, sum);
+    for (int c = 0; c < s.channels; ++c) {
+      const float* in = input + c / kGemmPanelRows * plane
+          + c % kGemmPanelRows;
+      for (int kh = 0; kh < s.kernel_h; ++kh) {
+        const int ih = ih0 + kh;
+        if (ih < 0 || ih >= s.height) { continue; }
+        for (int kw = 0; kw < s.kernel_w; ++kw) {
+          const int iw = iw0 + kw;
+          if (iw < 0 || iw >= s.width) { continue; }
+          const float x = in[(ih * s.width + iw) * kGemmPanelRows];
+          const float* w = weights
+              + ((c * s.kernel_h + kh) * s.kernel_w + kw) * kGemmPanelRows;
+          for (int r = 0; r < kGemmPanelRows; ++r) { sum[r] += x * w[r]; }
+        }
+      }
+    }
+    for (int r = 0; r < kGemmPanelRows; ++r) {
+      output[r] = slopes && sum[r] < 0 ? slopes[r] * sum[r] : sum[r];
+    }
+  }
+}
+
+// Spells out X for every row of a panel, so that each row's accumulator is
+// a named variable the compiler keeps in a register.
+#define GEMM_FOR_ROWS(X) X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7)
+
+// exp(x) = 2^k exp(r) with k = round(x / ln 2) and r = x - k ln 2, reduced
+// in two steps, and exp(r) from the Cephes expf polynomial. 2^k is applied as
+// two normal factors, so results past the float range overflow to inf or go
+// through the denormals to 0 as with std::exp, and x is clamped to where k
+// stays in [-150, 128]. The clamps take the constant first, so that NaN
+// passes through them.
+const float kExpHi = 89.f;
+const float kExpLo = -104.f;
+const float kLog2e = 1.44269504f;
+const float kLn2Hi = 0.693359375f;
+const float kLn2Lo = -2.12194440e-4f;
+const float kExpPoly[] = {1.9875691500e-4f, 1.3981999507e-3f,
+    8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+
+// Each vector variant processes width floats per step and hands the rest to
+// the scalar kernel.
+
+#ifdef __SSE2__
+#define DEFINE_SSE_KERNELS(name, intrinsic) \
+  void name##_sse(int n, const float* a, const float* b, float* y) { \
+    int i = 0; \
+    for (; i + 4 <= n; i += 4) { \
+      _mm_storeu_ps(y + i, intrinsic(_mm_loadu_ps(a + i), \
+          _mm_loadu_ps(b + i))); \
+    } \
+    name##_scalar(n - i, a + i, b + i, y + i); \
+  }
+
+DEFINE_SSE_KERNELS(add, _mm_add_ps);
+DEFINE_SSE_KERNELS(sub, _mm_sub_ps);
+DEFINE_SSE_KERNELS(mul, _mm_mul_ps);
+DEFINE_SSE_KERNELS(div, _mm_div_ps);
+DEFINE_SSE_KERNELS(max, _mm_max_ps);
+
+inline __m128 exp_ps(__m128 x) {
+  x = _mm_min_ps(_mm_set1_ps(kExpHi), x);
+  x = _mm_max_ps(_mm_set1_ps(kExpLo), x);
+  const __m128i k = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(kLog2e)));
+  const __m128 kf = _mm_cvtepi32_ps(k);
+  __m128 r = _mm_sub_ps(x, _mm_mul_ps(kf, _mm_set1_ps(kLn2Hi)));
+  r = _mm_sub_ps(r, _mm_mul_ps(kf, _mm_set1_ps(kLn2Lo)));
+  __m128 p = _mm_set1_ps(kExpPoly[0]);
+  for (int j = 1; j < 6; ++j) {
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpPoly[j]));
+  }
+  p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r);
+  p = _mm_add_ps(p, _mm_set1_ps(1.f));
+  const __m128i bias = _mm_set1_epi32(127);
+  const __m128i k1 = _mm_srai_epi32(k, 1);
+  const __m128 pow2k1 =
+      _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k1, bias), 23));
+  const __m128 pow2k2 = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(k, k1), bias), 23));
+  return _mm_mul_ps(_mm_mul_ps(p, pow2k1), pow2k2);
+}
+
+void exp_sse(int n, const float* x, float* y) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(y + i, exp_ps(_mm_loadu_ps(x + i)));
+  }
+  exp_scalar(n - i, x + i, y + i);
+}
+
+void prelu_sse(int n, const float* x, float slope, float* y) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 slopes = _mm_set1_ps(slope);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 v = _mm_loadu_ps(x + i);
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_max_ps(v, zero),
+        _mm_mul_ps(slopes, _mm_min_ps(v, zero))));
+  }
+  prelu_scalar(n - i, x + i, slope, y + i);
+}
+
+void softmax2_sse(int n, const float* x0, const float* x1, float* y0,
+    float* y1) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 sign = _mm_set1_ps(-0.f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 d = _mm_sub_ps(_mm_loadu_ps(x1 + i), _mm_loadu_ps(x0 + i));
+    const __m128 e = exp_ps(_mm_or_ps(d, sign));
+    const __m128 larger = _mm_div_ps(one, _mm_add_ps(one, e));
+    const __m128 smaller = _mm_mul_ps(e, larger);
+    const __m128 positive = _mm_cmpgt_ps(d, zero);
+    _mm_storeu_ps(y0 + i, _mm_or_ps(_mm_and_ps(positive, smaller),
+        _mm_andnot_ps(positive, larger)));
+    _mm_storeu_ps(y1 + i, _mm_or_ps(_mm_and_ps(positive, larger),
+        _mm_andnot_ps(positive, smaller)));
+  }
+  softmax2_scalar(n - i, x0 + i, x1 + i, y0 + i, y1 + i);
+}
+
+// An 8 x 4 block of C per step.
+void gemm_panel_sse(int rows, int n, int k, const float* a, const float* b,
+    int ldb, float* c, int ldc) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+#define GEMM_ZERO(r) __m128 c##r = _mm_setzero_ps();
+#define GEMM_MADD(r) \
+    c##r = _mm_add_ps(c##r, _mm_mul_ps(_mm_set1_ps(ap[r]), bv));
+#define GEMM_STORE(r) if (r < rows) { _mm_storeu_ps(c + r * ldc + j, c##r); }
+    GEMM_FOR_ROWS(GEMM_ZERO)
+    const float* ap = a;
+    const float* bp = b + j;
+    for (int p = 0; p < k; ++p, ap += kGemmPanelRows, bp += ldb) {
+      const __m128 bv = _mm_loadu_ps(bp);
+      GEMM_FOR_ROWS(GEMM_MADD)
+    }
+    GEMM_FOR_ROWS(GEMM_STORE)
+#undef GEMM_ZERO
+#undef GEMM_MADD
+#undef GEMM_STORE
+  }
+  gemm_columns_scalar(rows, j, n, k, a, b, ldb, c, ldc);
+}
+#endif  // __SSE2__
+
+#ifdef CAFFE_CPU_DISPATCH
+#define DEFINE_AVX2_KERNELS(name, intrinsic) \
+  CAFFE_TARGET_AVX2 \
+  void name##_avx2(int n, const float* a, const float* b, float* y) { \
+    int i = 0; \
+    for (; i + 8 <= n; i += 8) { \
+      _mm256_storeu_ps(y + i, intrinsic(_mm256_loadu_ps(a + i), \
+          _mm256_loadu_ps(b + i))); \
+    } \
+    name##_scalar(n - i, a + i, b + i, y + i); \
+  }
+
+DEFINE_AVX2_KERNELS(add, _mm256_add_ps);
+DEFINE_AVX2_KERNELS(sub, _mm256_sub_ps);
+DEFINE_AVX2_KERNELS(mul, _mm256_mul_ps);
+DEFINE_AVX2_KERNELS(div, _mm256_div_ps);
+DEFINE_AVX2_KERNELS(max, _mm256_max_ps);
+
+CAFFE_TARGET_AVX2 inline __m256 exp256_ps(__m256 x) {
+  x = _mm256_min_ps(_mm256_set1_ps(kExpHi), x);
+  x = _mm256_max_ps(_mm256_set1_ps(kExpLo), x);
+  const __m256i k =
+      _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(kLog2e)));
+  const __m256 kf = _mm256_cvtepi32_ps(k);
+  __m256 r = _mm256_fnmadd_ps(kf, _mm256_set1_ps(kLn2Hi), x);
+  r = _mm256_fnmadd_ps(kf, _mm256_set1_ps(kLn2Lo), r);
+  __m256 p = _mm256_set1_ps(kExpPoly[0]);
+  for (int j = 1; j < 6; ++j) {
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpPoly[j]));
+  }
+  p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, r);
+  p = _mm256_add_ps(p, _mm256_set1_ps(1.f));
+  const __m256i bias = _mm256_set1_epi32(127);
+  const __m256i k1 = _mm256_srai_epi32(k, 1);
+  const __m256 pow2k1 =
+      _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(k1, bias), 23));
+  const __m256 pow2k2 = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_add_epi32(_mm256_sub_epi32(k, k1), bias), 23));
+  return _mm256_mul_ps(_mm256_mul_ps(p, pow2k1), pow2k2);
+}
+
+CAFFE_TARGET_AVX2 void exp_avx2(int n, const float* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, exp256_ps(_mm256_loadu_ps(x + i)));
+  }
+  exp_scalar(n - i, x + i, y + i);
+}
+
+CAFFE_TARGET_AVX2 void prelu_avx2(int n, const float* x, float slope,
+    float* y) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 slopes = _mm256_set1_ps(slope);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 v = _mm256_loadu_ps(x + i);
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_max_ps(v, zero),
+        _mm256_mul_ps(slopes, _mm256_min_ps(v, zero))));
+  }
+  prelu_scalar(n - i, x + i, slope, y + i);
+}
+
+CAFFE_TARGET_AVX2 void softmax2_avx2(int n, const float* x0, const float* x1,
+    float* y0, float* y1) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 d =
+        _mm256_sub_ps(_mm256_loadu_ps(x1 + i), _mm256_loadu_ps(x0 + i));
+    const __m256 e = exp256_ps(_mm256_or_ps(d, sign));
+    const __m256 larger = _mm256_div_ps(one, _mm256_add_ps(one, e));
+    const __m256 smaller = _mm256_mul_ps(e, larger);
+    const __m256 positive = _mm256_cmp_ps(d, zero, _CMP_GT_OQ);
+    _mm256_storeu_ps(y0 + i, _mm256_blendv_ps(larger, smaller, positive));
+    _mm256_storeu_ps(y1 + i, _mm256_blendv_ps(smaller, larger, positive));
+  }
+  softmax2_scalar(n - i, x0 + i, x1 + i, y0 + i, y1 + i);
+}
+
+// An 8 x 8 block of C per step; a partial block loads and stores under a
+// mask.
+CAFFE_TARGET_AVX2 void gemm_panel_avx2(int rows, int n, int k, const float* a,
+    const float* b, int ldb, float* c, int ldc) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (int j = 0; j < n; j += 8) {
+    const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), lanes);
+#define GEMM_ZERO(r) __m256 c##r = _mm256_setzero_ps();
+#define GEMM_MADD(r) c##r = _mm256_fmadd_ps(_mm256_set1_ps(ap[r]), bv, c##r);
+#define GEMM_STORE(r) \
+    if (r < rows) { _mm256_maskstore_ps(c + r * ldc + j, mask, c##r); }
+    GEMM_FOR_ROWS(GEMM_ZERO)
+    const float* ap = a;
+    const float* bp = b + j;
+    if (j + 8 <= n) {
+      for (int p = 0; p < k; ++p, ap += kGemmPanelRows, bp += ldb) {
+        const __m256 bv = _mm256_loadu_ps(bp);
+        GEMM_FOR_ROWS(GEMM_MADD)
+      }
+    } else {
+      for (int p = 0; p < k; ++p, ap += kGemmPanelRows, bp += ldb) {
+        const __m256 bv = _mm256_maskload_ps(bp, mask);
+        GEMM_FOR_ROWS(GEMM_MADD)
+      }
+    }
+    GEMM_FOR_ROWS(GEMM_STORE)
+#undef GEMM_ZERO
+#undef GEMM_MADD
+#undef GEMM_STORE
+  }
+}
+
+// F16C widens FP16, and BF16 only needs a shift.
+CAFFE_TARGET_AVX2 void half_to_float_avx2(int n, const uint16_t* x,
+    HalfFormat format, float* y) {
+  int i = 0;
+  if (format == HALF_FP16) {
+    for (; i + 8 <= n; i += 8) {
+      _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+    }
+  } else {
+    for (; i + 8 <= n; i += 8) {
+      const __m256i wide = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+      _mm256_storeu_ps(y + i,
+          _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16)));
+    }
+  }
+  half_to_float_scalar(n - i, x + i, format, y + i);
+}
+
+CAFFE_TARGET_AVX2 inline void conv_nchw8c_store_avx2(__m256 sum,
+    const float* slopes, float* output) {
+  if (slopes) {
+    const __m256 zero = _mm256_setzero_ps();
+    sum = _mm256_add_ps(_mm256_max_ps(sum, zero),
+        _mm256_mul_ps(_mm256_loadu_ps(slopes), _mm256_min_ps(sum, zero)));
+  }
+  _mm256_storeu_ps(output, sum);
+}
+
+// The block's 8 output channels are one vector. Runs of 4 output pixels
+// whose taps all lie inside the row share each weight load; the pixels at
+// the borders go one at a time.
+CAFFE_TARGET_AVX2 void conv_nchw8c_row_avx2(const BlockedConvShape& s,
+    const float* input, const float* weights, const float* bias,
+    const float* slopes, int oh, float* output) {
+  const int plane = s.height * s.width * kGemmPanelRows;
+  const int ih0 = oh * s.stride_h - s.pad_h;
+  const int kh_begin = std::max(0, -ih0);
+  const int kh_end = std::min(s.kernel_h, s.height - ih0);
+  // The output pixels [ow_begin, ow_end) need no horizontal padding.
+  const int ow_begin = std::min(s.output_width,
+      (s.pad_w + s.stride_w - 1) / s.stride_w);
+  const int last_iw0 = s.width - s.kernel_w + s.pad_w;
+  const int ow_end = std::max(ow_begin, std::min(s.output_width,
+      last_iw0 < 0 ? 0 : last_iw0 / s.stride_w + 1));
+  const int step = s.stride_w * kGemmPanelRows;
+  const __m256 bias_vector = _mm256_loadu_ps(bias);
+  for (int ow = 0; ow < s.output_width; ) {
+    const int iw0 = ow * s.stride_w - s.pad_w;
+    if (ow >= ow_begin && ow + 4 <= ow_end) {
+      __m256 sum0 = bias_vector, sum1 = bias_vector;
+      __m256 sum2 = bias_vector, sum3 = bias_vector;
+      for (int c = 0; c < s.channels; ++c) {
+        const float* in = input + c / kGemmPanelRows * plane
+            + c % kGemmPanelRows;
+        for (int kh = kh_begin; kh < kh_end; ++kh) {
+          const float* x = in + ((ih0 + kh) * s.width + iw0) * kGemmPanelRows;
+          const float* w = weights
+              + (c * s.kernel_h + kh) * s.kernel_w * kGemmPanelRows;
+          for (int kw = 0; kw < s.kernel_w;
+               ++kw, x += kGemmPanelRows, w += kGemmPanelRows) {
+            const __m256 wv = _mm256_loadu_ps(w);
+            sum0 = _mm256_fmadd_ps(_mm256_set1_ps(x[0]), wv, sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_set1_ps(x[step]), wv, sum1);
+            sum2 = _mm256_fmadd_ps(_mm256_set1_ps(x[2 * step]), wv, sum2);
+            sum3 = _mm256_fmadd_ps(_mm256_set1_ps(x[3 * step]), wv, sum3);
+          }
+        }
+      }
+      float* out = output + ow * kGemmPanelRows;
+      conv_nchw8c_store_avx2(sum0, slopes, out);
+      conv_nchw8c_store_avx2(sum1, slopes, out + kGemmPanelRows);
+      conv_nchw8c_store_avx2(sum2, slopes, out + 2 * kGemmPanelRows);
+      conv_nchw8c_store_avx2(sum3, slopes, out + 3 * kGemmPanelRows);
+      ow += 4;
+      continue;
+    }
+    const int kw_begin = std::max(0, -iw0);
+    const int kw_end = std::min(s.kernel_w, s.width - iw0);
+    __m256 sum = bias_vector;
+    for (int c = 0; c < s.channels; ++c) {
+      const float* in = input + c / kGemmPanelRows * plane
+          + c % kGemmPanelRows;
+      for (int kh = kh_begin; kh < kh_end; ++kh) {
+        const float* x = in + (ih0 + kh) * s.width * kGemmPanelRows;
+        const float* w = weights
+            + (c * s.kernel_h + kh) * s.kernel_w * kGemmPanelRows;
+        for (int kw = kw_begin; kw < kw_end; ++kw) {
+          sum = _mm256_fmadd_ps(_mm256_set1_ps(x[(iw0 + kw) * kGemmPanelRows]),
+              _mm256_loadu_ps(w + kw * kGemmPanelRows), sum);
+        }
+      }
+    }
+    conv_nchw8c_store_avx2(sum, slopes, output + ow * kGemmPanelRows);
+    ++ow;
+  }
+}
+
+// GCC 12 warns about the undefined vectors avx512fintrin.h starts from.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+#define DEFINE_AVX512_KERNELS(name, intrinsic) \
+  CAFFE_TARGET_AVX512 \
+  void name##_avx512(int n, const float* a, const float* b, float* y) { \
+    int i = 0; \
+    for (; i + 16 <= n; i += 16) { \
+      _mm512_storeu_ps(y + i, intrinsic(_mm512_loadu_ps(a + i), \
+          _mm512_loadu_ps(b + i))); \
+    } \
+    name##_scalar(n - i, a + i, b + i, y + i); \
+  }
+
+DEFINE_AVX512_KERNELS(add, _mm512_add_ps);
+DEFINE_AVX512_KERNELS(sub, _mm512_sub_ps);
+DEFINE_AVX512_KERNELS(mul, _mm512_mul_ps);
+DEFINE_AVX512_KERNELS(div, _mm512_div_ps);
+DEFINE_AVX512_KERNELS(max, _mm512_max_ps);
+
+CAFFE_TARGET_AVX512 inline __m512 exp512_ps(__m512 x) {
+  x = _mm512_min_ps(_mm512_set1_ps(kExpHi), x);
+  x = _mm512_max_ps(_mm512_set1_ps(kExpLo), x);
+  const __m512i k =
+      _mm512_cvtps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(kLog2e)));
+  const __m512 kf = _mm512_cvtepi32_ps(k);
+  __m512 r = _mm512_fnmadd_ps(kf, _mm512_set1_ps(kLn2Hi), x);
+  r = _mm512_fnmadd_ps(kf, _mm512_set1_ps(kLn2Lo), r);
+  __m512 p = _mm512_set1_ps(kExpPoly[0]);
+  for (int j = 1; j < 6; ++j) {
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpPoly[j]));
+  }
+  p = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, r);
+  p = _mm512_add_ps(p, _mm512_set1_ps(1.f));
+  const __m512i bias = _mm512_set1_epi32(127);
+  const __m512i k1 = _mm512_srai_epi32(k, 1);
+  const __m512 pow2k1 =
+      _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(k1, bias), 23));
+  const __m512 pow2k2 = _mm512_castsi512_ps(
+      _mm512_slli_epi32(_mm512_add_epi32(_mm512_sub_epi32(k, k1), bias), 23));
+  return _mm512_mul_ps(_mm512_mul_ps(p, pow2k1), pow2k2);
+}
+
+CAFFE_TARGET_AVX512 void exp_avx512(int n, const float* x, float* y) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(y + i, exp512_ps(_mm512_loadu_ps(x + i)));
+  }
+  exp_scalar(n - i, x + i, y + i);
+}
+
+CAFFE_TARGET_AVX512 void prelu_avx512(int n, const float* x, float slope,
+    float* y) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 slopes = _mm512_set1_ps(slope);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 v = _mm512_loadu_ps(x + i);
+    _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_max_ps(v, zero),
+        _mm512_mul_ps(slopes, _mm512_min_ps(v, zero))));
+  }
+  prelu_scalar(n - i, x + i, slope, y + i);
+}
+
+CAFFE_TARGET_AVX512 void softmax2_avx512(int n, const float* x0,
+    const float* x1, float* y0, float* y1) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 one = _mm512_set1_ps(1.f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 d =
+        _mm512_sub_ps(_mm512_loadu_ps(x1 + i), _mm512_loadu_ps(x0 + i));
+    const __m512 e = exp512_ps(_mm512_sub_ps(zero, _mm512_abs_ps(d)));
+    const __m512 larger = _mm512_div_ps(one, _mm512_add_ps(one, e));
+    const __m512 smaller = _mm512_mul_ps(e, larger);
+    const __mmask16 positive = _mm512_cmp_ps_mask(d, zero, _CMP_GT_OQ);
+    _mm512_storeu_ps(y0 + i, _mm512_mask_blend_ps(positive, larger, smaller));
+    _mm512_storeu_ps(y1 + i, _mm512_mask_blend_ps(positive, smaller, larger));
+  }
+  softmax2_scalar(n - i, x0 + i, x1 + i, y0 + i, y1 + i);
+}
+
+// An 8 x 16 block of C per step, masked like the AVX2 kernel.
+CAFFE_TARGET_AVX512 void gemm_panel_avx512(int rows, int n, int k,
+    const float* a, const float* b, int ldb, float* c, int ldc) {
+  for (int j = 0; j < n; j += 16) {
+    const __mmask16 mask = j + 16 <= n ? 0xffff : (1 << (n - j)) - 1;
+#define GEMM_ZERO(r) __m512 c##r = _mm512_setzero_ps();
+#define GEMM_MADD(r) c##r = _mm512_fmadd_ps(_mm512_set1_ps(ap[r]), bv, c##r);
+#define GEMM_STORE(r) \
+    if (r < rows) { _mm512_mask_storeu_ps(c + r * ldc + j, mask, c##r); }
+    GEMM_FOR_ROWS(GEMM_ZERO)
+    const float* ap = a;
+    const float* bp = b + j;
+    for (int p = 0; p < k; ++p, ap += kGemmPanelRows, bp += ldb) {
+      const __m512 bv = _mm512_maskz_loadu_ps(mask, bp);
+      GEMM_FOR_ROWS(GEMM_MADD)
+    }
+    GEMM_FOR_ROWS(GEMM_STORE)
+#undef GEMM_ZERO
+#undef GEMM_MADD
+#undef GEMM_STORE
+  }
+}
+
+#pragma GCC diagnostic pop
+#endif  // CAFFE_CPU_DISPATCH
+
+typedef void (*BinaryKernel)(int, const float*, const float*, float*);
+
+struct Kernels {
+  BinaryKernel add, sub, mul, div, max;
+  void (*exp)(int, const float*, float*);
+  void (*prelu)(int, const float*, float, float*);
+  void (*softmax2)(int, const float*, const float*, float*, float*);
+  void (*gemm_panel)(int, int, int, const float*, const float*, int, float*,
+      int);
+  void (*conv_nchw8c_row)(const BlockedConvShape&, const float*,
+      const float*, const float*, const float*, int, float*);
+  void (*half_to_float)(int, const uint16_t*, HalfFormat, float*);
+};
+
+CpuLevel DetectCpuLevel() {
+#ifdef CAFFE_CPU_DISPATCH
+  // Also checks that the OS saves the wider registers. The AVX-512 level
+  // reuses the AVX2 convolution and half conversion, so it needs AVX2 too.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("f16c")) {
+    return __builtin_cpu_supports("avx512f") ? CPU_LEVEL_AVX512 :
+        CPU_LEVEL_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) { return CPU_LEVEL_SSE4; }
+#endif
+  return CPU_LEVEL_BASELINE;
+}
+
+Kernels SelectKernels(CpuLevel level) {
+  Kernels k = {add_scalar, sub_scalar, mul_scalar, div_scalar, max_scalar,
+      exp_scalar, prelu_scalar, softmax2_scalar, gemm_panel_scalar,
+      conv_nchw8c_row_scalar, half_to_float_scalar};
+#ifdef __SSE2__
+  const Kernels sse = {add_sse, sub_sse, mul_sse, div_sse, max_sse, exp_sse,
+      prelu_sse, softmax2_sse, gemm_panel_sse, conv_nchw8c_row_scalar,
+      half_to_float_scalar};
+  k = sse;
+#endif
+#ifdef CAFFE_CPU_DISPATCH
+  if (level >= CPU_LEVEL_AVX2) {
+    const Kernels avx2 = {add_avx2, sub_avx2, mul_avx2, div_avx2, max_avx2,
+        exp_avx2, prelu_avx2, softmax2_avx2, gemm_panel_avx2,
+        conv_nchw8c_row_avx2, half_to_float_avx2};
+    k = avx2;
+  }
+  if (level >= CPU_LEVEL_AVX512) {
+    const Kernels avx512 = {add_avx512, sub_avx512, mul_avx512, div_avx512,
+        max_avx512, exp_avx512, prelu_avx512, softmax2_avx512,
+        gemm_panel_avx512, conv_nchw8c_row_avx2, half_to_float_avx2};
+    k = avx512;
+  }
+#endif
+  return k;
+}
+
+const CpuLevel supported_level = DetectCpuLevel();
+CpuLevel current_level = supported_level;
+Kernels kernels = SelectKernels(supported_level);
+
+}  // namespace
+
+CpuLevel cpu_level_supported() { return supported_level; }
+
+CpuLevel cpu_level() { return current_level; }
+
+void set_cpu_level(CpuLevel level) {
+  current_level = std::min(level, supported_level);
+  kernels = SelectKernels(current_level);
+}
+
+const char* cpu_level_name(CpuLevel level) {
+  switch (level) {
+  case CPU_LEVEL_SSE4:
+    return "SSE4";
+  case CPU_LEVEL_AVX2:
+    return "AVX2";
+  case CPU_LEVEL_AVX512:
+    return "AVX-512";
+  default:
+    return "baseline";
+  }
+}
+
+void cpu_add(int n, const float* a, const float* b, float* y) {
+  kernels.add(n, a, b, y);
+}
+
+void cpu_sub(int n, const float* a, const float* b, float* y) {
+  kernels.sub(n, a, b, y);
+}
+
+void cpu_mul(int n, const float* a, const float* b, float* y) {
+  kernels.mul(n, a, b, y);
+}
+
+void cpu_div(int n, const float* a, const float* b, float* y) {
+  kernels.div(n, a, b, y);
+}
+
+void cpu_max(int n, const float* a, const float* b, float* y) {
+  kernels.max(n, a, b, y);
+}
+
+void cpu_exp(int n, const float* x, float* y) {
+  kernels.exp(n, x, y);
+}
+
+void cpu_prelu(int n, const float* x, float slope, float* y) {
+  kernels.prelu(n, x, slope, y);
+}
+
+void cpu_softmax2(int n, const float* x0, const float* x1, float* y0,
+    float* y1) {
+  kernels.softmax2(n, x0, x1, y0, y1);
+}
+
+void cpu_gemm_pack(int M, int K, const float* A, float* packed) {
+  for (int row = 0; row < M; row += kGemmPanelRows) {
+    const int rows = std::min(kGemmPanelRows, M - row);
+    for (int p = 0; p < K; ++p, packed += kGemmPanelRows) {
+      for (int r = 0; r < kGemmPanelRows; ++r) {
+        packed[r] = r < rows ? A[(row + r) * K + p] : 0.f;
+      }
+    }
+  }
+}
+
+void cpu_gemm_packed(int M, int N, int K, const float* packed, const float* B,
+    int ldb, float* C, int ldc) {
+  for (int row = 0; row < M; row += kGemmPanelRows) {
+    kernels.gemm_panel(std::min(kGemmPanelRows, M - row), N, K,
+        packed + row * K, B, ldb, C + row * ldc, ldc);
+  }
+}
+
+void cpu_conv_nchw8c_row(const BlockedConvShape& shape, const float* input,
+    const float* weights, const float* bias, const float* slopes, int oh,
+    float* output) {
+  kernels.conv_nchw8c_row(shape, input, weights, bias, slopes, oh, output);
+}
+
+void cpu_float_to_half(int n, const float* x, HalfFormat format, uint16_t* y) {
+  // Only used when weights are loaded, so there is no vector variant.
+  if (format == HALF_FP16) {
+    for (int i = 0; i < n; ++i) { y[i] = float_to_fp16(x[i]); }
+  } else {
+    for (int i = 0; i < n; ++i) { y[i] = float_to_bf16(x[i]); }
+  }
+}
+
+void cpu_half_to_float(int n, const uint16_t* x, HalfFormat format, float* y) {
+  kernels.half_to_float(n, x, format, y);
+}
+
+}  // namespace caffe
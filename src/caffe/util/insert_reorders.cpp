@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_reorders.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Whether the layer is built with its Caffe engine rather than with cuDNN,
+// whose layers take no blocked bottoms.
+template <typename Engine>
+bool UsesCaffeEngine(Engine engine, Engine caffe_engine) {
+#ifdef USE_CUDNN
+  return engine == caffe_engine;
+#else
+  return true;
+#endif
+}
+
+enum BlockedUse {
+  BLOCKED_NEVER,
+  BLOCKED_ALWAYS,      // Bottoms in the plain layout are reordered.
+  BLOCKED_IF_BOTTOMS   // Only when all bottoms are already blocked.
+};
+
+BlockedUse GetBlockedUse(const LayerParameter& layer_param) {
+  const string& type = layer_param.type();
+  if (type == "Convolution") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    bool blocked = conv_param.group() == 1 && conv_param.axis() == 1 &&
+        !conv_param.force_nd_im2col() && conv_param.kernel_size_size() <= 2 &&
+        UsesCaffeEngine(conv_param.engine(), ConvolutionParameter_Engine_CAFFE);
+    for (int i = 0; i < conv_param.dilation_size(); ++i) {
+      blocked &= conv_param.dilation(i) == 1;
+    }
+    return blocked ? BLOCKED_ALWAYS : BLOCKED_NEVER;
+  }
+  if (type == "ReLU") {
+    return UsesCaffeEngine(layer_param.relu_param().engine(),
+        ReLUParameter_Engine_CAFFE) ? BLOCKED_IF_BOTTOMS : BLOCKED_NEVER;
+  }
+  if (type == "Pooling") {
+    const PoolingParameter& pool_param = layer_param.pooling_param();
+    const bool blocked = layer_param.top_size() == 1 &&
+        (pool_param.pool() == PoolingParameter_PoolMethod_MAX ||
+         pool_param.pool() == PoolingParameter_PoolMethod_AVE) &&
+        UsesCaffeEngine(pool_param.engine(), PoolingParameter_Engine_CAFFE);
+    return blocked ? BLOCKED_IF_BOTTOMS : BLOCKED_NEVER;
+  }
+  if (type == "Concat") {
+    const ConcatParameter& concat_param = layer_param.concat_param();
+    const int axis = concat_param.has_concat_dim() ?
+        concat_param.concat_dim() : concat_param.axis();
+    return axis == 1 ? BLOCKED_IF_BOTTOMS : BLOCKED_NEVER;
+  }
+  if (type == "PReLU" || type == "Eltwise") {
+    return BLOCKED_IF_BOTTOMS;
+  }
+  return BLOCKED_NEVER;
+}
+
+// The layouts the latest version of a blob is available in.
+struct BlobLayouts {
+  BlobLayouts() : plain(true), blocked(false), consumed(false) {}
+  bool plain;
+  bool blocked;
+  string blocked_name;
+  // Whether a layer reads the latest version.
+  bool consumed;
+};
+
+string UniqueName(const string& name, set<string>* names) {
+  string unique_name = name;
+  for (int i = 2; names->count(unique_name); ++i) {
+    ostringstream numbered_name;
+    numbered_name << name << "_" << i;
+    unique_name = numbered_name.str();
+  }
+  names->insert(unique_name);
+  return unique_name;
+}
+
+void AddReorderLayer(const string& bottom, const string& top,
+    ReorderParameter_Layout layout, set<string>* layer_names,
+    NetParameter* param) {
+  // Named after the plain blob.
+  LayerParameter* layer_param = param->add_layer();
+  layer_param->set_name(UniqueName(layout == ReorderParameter_Layout_NCHW8C ?
+      bottom + "_to_nchw8c" : top + "_to_nchw", layer_names));
+  layer_param->set_type("Reorder");
+  layer_param->add_bottom(bottom);
+  layer_param->add_top(top);
+  layer_param->mutable_reorder_param()->set_layout(layout);
+}
+
+}  // namespace
+
+void InsertReorders(const NetParameter& param,
+    NetParameter* param_reordered) {
+  // Initialize by copying from the input NetParameter.
+  param_reordered->CopyFrom(param);
+  param_reordered->clear_layer();
+  set<string> layer_names;
+  set<string> blob_names(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    layer_names.insert(layer_param.name());
+    blob_names.insert(layer_param.bottom().begin(),
+        layer_param.bottom().end());
+    blob_names.insert(layer_param.top().begin(), layer_param.top().end());
+  }
+  map<string, BlobLayouts> layouts;
+  vector<string> top_names;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    const BlockedUse use = GetBlockedUse(layer_param);
+    bool blocked = use == BLOCKED_ALWAYS;
+    if (use == BLOCKED_IF_BOTTOMS && layer_param.bottom_size() > 0) {
+      blocked = true;
+      for (int j = 0; j < layer_param.bottom_size(); ++j) {
+        const BlobLayouts& bottom_layouts = layouts[layer_param.bottom(j)];
+        // Computing in place would leave a plain copy behind.
+        const bool in_place = std::find(layer_param.top().begin(),
+            layer_param.top().end(), layer_param.bottom(j)) !=
+            layer_param.top().end();
+        blocked &= bottom_layouts.blocked &&
+            !(in_place && bottom_layouts.plain);
+      }
+    }
+    // Bring the bottoms into the layout of the layer.
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      BlobLayouts& bottom_layouts = layouts[blob_name];
+      bottom_layouts.consumed = true;
+      if (blocked && !bottom_layouts.blocked) {
+        bottom_layouts.blocked_name =
+            UniqueName(BlockedBlobName(blob_name), &blob_names);
+        AddReorderLayer(blob_name, bottom_layouts.blocked_name,
+            ReorderParameter_Layout_NCHW8C, &layer_names, param_reordered);
+        bottom_layouts.blocked = true;
+      } else if (!blocked && !bottom_layouts.plain) {
+        AddReorderLayer(bottom_layouts.blocked_name, blob_name,
+            ReorderParameter_Layout_NCHW, &layer_names, param_reordered);
+        bottom_layouts.plain = true;
+      }
+    }
+    LayerParameter* reordered_layer_param = param_reordered->add_layer();
+    reordered_layer_param->CopyFrom(layer_param);
+    if (blocked) {
+      for (int j = 0; j < layer_param.bottom_size(); ++j) {
+        reordered_layer_param->set_bottom(j,
+            layouts[layer_param.bottom(j)].blocked_name);
+      }
+    }
+    // The tops are new versions, only in the layout of the layer.
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& blob_name = layer_param.top(j);
+      if (!layouts.count(blob_name)) {
+        top_names.push_back(blob_name);
+      }
+      BlobLayouts& top_layouts = layouts[blob_name];
+      const bool in_place = std::find(layer_param.bottom().begin(),
+          layer_param.bottom().end(), blob_name) != layer_param.bottom().end();
+      if (blocked) {
+        if (!in_place) {
+          top_layouts.blocked_name =
+              UniqueName(BlockedBlobName(blob_name), &blob_names);
+        }
+        reordered_layer_param->set_top(j, top_layouts.blocked_name);
+      }
+      top_layouts.plain = !blocked;
+      top_layouts.blocked = blocked;
+      top_layouts.consumed = false;
+    }
+  }
+  // Reorder what would be the blocked outputs of the net.
+  for (int i = 0; i < top_names.size(); ++i) {
+    const BlobLayouts& top_layouts = layouts[top_names[i]];
+    if (!top_layouts.consumed && !top_layouts.plain) {
+      AddReorderLayer(top_layouts.blocked_name, top_names[i],
+          ReorderParameter_Layout_NCHW, &layer_names, param_reordered);
+    }
+  }
+}
+
+string BlockedBlobName(const string& blob_name) {
+  return blob_name + "_nchw8c";
+}
+
+}  // namespace caffe
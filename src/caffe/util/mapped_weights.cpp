@@ -0,0 +1,117 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kMagic[] = "CAFFEMAP";
+const int kMagicSize = 8;
+const int kAlignment = 64;
+const char kExtension[] = ".caffemap";
+
+}  // namespace
+
+bool IsMappedWeightsFile(const string& filename) {
+  const string extension(kExtension);
+  return filename.size() >= extension.size() &&
+      filename.compare(filename.size() - extension.size(), extension.size(),
+      extension) == 0;
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  std::ofstream file(filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  CHECK(file) << "Cannot create " << filename;
+  file.write(kMagic, kMagicSize);
+  uint64_t offset = kMagicSize;
+  const char padding[kAlignment] = {0};
+  MappedWeightsIndex index;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    if (layer_param.blobs_size() == 0) { continue; }
+    MappedWeightsIndex::LayerBlobs* layer = index.add_layer();
+    layer->set_name(layer_param.name());
+    for (int j = 0; j < layer_param.blobs_size(); ++j) {
+      // FromProto also reads legacy shapes and double data.
+      Blob<float> blob;
+      blob.FromProto(layer_param.blobs(j));
+      const uint64_t aligned =
+          (offset + kAlignment - 1) / kAlignment * kAlignment;
+      file.write(padding, aligned - offset);
+      MappedWeightsIndex::BlobLocation* location = layer->add_blobs();
+      for (int k = 0; k < blob.num_axes(); ++k) {
+        location->mutable_shape()->add_dim(blob.shape(k));
+      }
+      location->set_offset(aligned);
+      file.write(reinterpret_cast<const char*>(blob.cpu_data()),
+          blob.count() * sizeof(float));
+      offset = aligned + blob.count() * sizeof(float);
+    }
+  }
+  string serialized_index;
+  CHECK(index.SerializeToString(&serialized_index));
+  const uint64_t index_size = serialized_index.size();
+  file.write(serialized_index.data(), index_size);
+  file.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
+  file.write(kMagic, kMagicSize);
+  CHECK(file) << "Error writing " << filename;
+}
+
+MappedWeights::MappedWeights(const string& filename)
+    : data_(NULL), size_(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Cannot stat " << filename;
+  size_ = file_stat.st_size;
+  CHECK_GE(size_, 2 * kMagicSize + sizeof(uint64_t))
+      << filename << " is not a mapped weights file.";
+  // Private and writable: the pages stay shared until written.
+  void* data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED) << "Cannot map " << filename;
+  data_ = static_cast<char*>(data);
+  const char* trailer = data_ + size_ - kMagicSize;
+  CHECK(memcmp(data_, kMagic, kMagicSize) == 0 &&
+      memcmp(trailer, kMagic, kMagicSize) == 0)
+      << filename << " is not a mapped weights file.";
+  uint64_t index_size;
+  memcpy(&index_size, trailer - sizeof(index_size), sizeof(index_size));
+  const uint64_t index_end = size_ - kMagicSize - sizeof(index_size);
+  CHECK_LE(index_size, index_end - kMagicSize)
+      << "Corrupt index in " << filename;
+  const uint64_t data_end = index_end - index_size;
+  CHECK(index_.ParseFromArray(data_ + data_end, index_size))
+      << "Corrupt index in " << filename;
+  for (int i = 0; i < index_.layer_size(); ++i) {
+    for (int j = 0; j < index_.layer(i).blobs_size(); ++j) {
+      const MappedWeightsIndex::BlobLocation& location =
+          index_.layer(i).blobs(j);
+      uint64_t count = 1;
+      for (int k = 0; k < location.shape().dim_size(); ++k) {
+        count *= location.shape().dim(k);
+      }
+      CHECK(location.offset() % sizeof(float) == 0 &&
+          location.offset() + count * sizeof(float) <= data_end)
+          << "Blob " << j << " of layer " << index_.layer(i).name()
+          << " lies outside the data of " << filename;
+    }
+  }
+}
+
+MappedWeights::~MappedWeights() {
+  munmap(data_, size_);
+}
+
+}  // namespace caffe
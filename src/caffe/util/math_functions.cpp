@@ -1,11 +1,15 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -31,6 +35,49 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
       ldb, beta, C, N);
 }
 
+template <>
+void caffe_cpu_gemm_pack<float>(const int M, const int K, const float* A,
+    float* packed) {
+  cpu_gemm_pack(M, K, A, packed);
+}
+
+template <>
+void caffe_cpu_gemm_pack<double>(const int M, const int K, const double* A,
+    double* packed) {
+  for (int row = 0; row < M; row += kGemmPanelRows) {
+    const int rows = std::min(kGemmPanelRows, M - row);
+    for (int p = 0; p < K; ++p, packed += kGemmPanelRows) {
+      for (int r = 0; r < kGemmPanelRows; ++r) {
+        packed[r] = r < rows ? A[(row + r) * K + p] : 0.;
+      }
+    }
+  }
+}
+
+template <>
+void caffe_cpu_gemm_packed<float>(const int M, const int N, const int K,
+    const float* packed, const float* B, const int ldb, float* C,
+    const int ldc) {
+  cpu_gemm_packed(M, N, K, packed, B, ldb, C, ldc);
+}
+
+template <>
+void caffe_cpu_gemm_packed<double>(const int M, const int N, const int K,
+    const double* packed, const double* B, const int ldb, double* C,
+    const int ldc) {
+  for (int i = 0; i < M; ++i) {
+    const double* a = packed + i / kGemmPanelRows * kGemmPanelRows * K +
+        i % kGemmPanelRows;
+    for (int j = 0; j < N; ++j) {
+      double sum = 0;
+      for (int p = 0; p < K; ++p) {
+        sum += a[p * kGemmPanelRows] * B[p * ldb + j];
+      }
+      C[i * ldc + j] = sum;
+    }
+  }
+}
+
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
@@ -126,10 +173,54 @@ void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
   cblas_daxpby(N, alpha, X, 1, beta, Y, 1);
 }
 
+namespace {
+
+typedef void (*BinaryKernel)(int, const float*, const float*, float*);
+typedef void (*UnaryKernel)(int, const float*, float*);
+
+void BinaryRange(BinaryKernel kernel, const float* a, const float* b,
+    float* y, int begin, int end) {
+  kernel(end - begin, a + begin, b + begin, y + begin);
+}
+
+void UnaryRange(UnaryKernel kernel, const float* a, float* y, int begin,
+    int end) {
+  kernel(end - begin, a + begin, y + begin);
+}
+
+// Split a float elementwise kernel whose elements cost about work_per_item
+// multiply-adds over the thread pool. Calls too small to split skip binding
+// the range.
+void ParallelBinary(BinaryKernel kernel, int n, const float* a,
+    const float* b, float* y, int work_per_item) {
+  const int grain = ParallelGrain(work_per_item);
+  if (n < 2 * grain) {
+    kernel(n, a, b, y);
+    return;
+  }
+  ParallelFor(0, n, grain, boost::bind(&BinaryRange, kernel, a, b, y, _1, _2));
+}
+
+void ParallelUnary(UnaryKernel kernel, int n, const float* a, float* y,
+    int work_per_item) {
+  const int grain = ParallelGrain(work_per_item);
+  if (n < 2 * grain) {
+    kernel(n, a, y);
+    return;
+  }
+  ParallelFor(0, n, grain, boost::bind(&UnaryRange, kernel, a, y, _1, _2));
+}
+
+}  // namespace
+
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsAdd(n, a, b, y);
+#ifdef USE_MKL
+  ParallelBinary(vsAdd, n, a, b, y, 1);
+#else
+  ParallelBinary(cpu_add, n, a, b, y, 1);
+#endif
 }
 
 template <>
@@ -141,7 +232,11 @@ void caffe_add<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsSub(n, a, b, y);
+#ifdef USE_MKL
+  ParallelBinary(vsSub, n, a, b, y, 1);
+#else
+  ParallelBinary(cpu_sub, n, a, b, y, 1);
+#endif
 }
 
 template <>
@@ -153,7 +248,11 @@ void caffe_sub<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsMul(n, a, b, y);
+#ifdef USE_MKL
+  ParallelBinary(vsMul, n, a, b, y, 1);
+#else
+  ParallelBinary(cpu_mul, n, a, b, y, 1);
+#endif
 }
 
 template <>
@@ -165,7 +264,11 @@ void caffe_mul<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsDiv(n, a, b, y);
+#ifdef USE_MKL
+  ParallelBinary(vsDiv, n, a, b, y, 1);
+#else
+  ParallelBinary(cpu_div, n, a, b, y, 1);
+#endif
 }
 
 template <>
@@ -198,7 +301,12 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
-  vsExp(n, a, y);
+  // The range reduction and polynomial take about 16 operations.
+#ifdef USE_MKL
+  ParallelUnary(vsExp, n, a, y, 16);
+#else
+  ParallelUnary(cpu_exp, n, a, y, 16);
+#endif
 }
 
 template <>
@@ -0,0 +1,205 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/net_profiler.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Quote a layer name or type for JSON.
+string JsonString(const string& value) {
+  ostringstream quoted;
+  quoted << '"';
+  for (int i = 0; i < value.size(); ++i) {
+    const char c = value[i];
+    if (c == '"' || c == '\\') {
+      quoted << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted << ' ';
+    } else {
+      quoted << c;
+    }
+  }
+  quoted << '"';
+  return quoted.str();
+}
+
+}  // namespace
+
+template <typename Dtype>
+NetProfiler<Dtype>::NetProfiler(Net<Dtype>* net, int sample_period,
+    int max_trace_events)
+    : net_(net), sample_period_(sample_period),
+      max_trace_events_(max_trace_events), before_forward_(this),
+      after_forward_(this), mutex_(new boost::mutex()) {
+  CHECK_GT(sample_period, 0);
+  CHECK_GE(max_trace_events, 0);
+  const int num_layers = net_->layers().size();
+  calls_seen_.resize(num_layers, 0);
+  starts_.resize(num_layers);
+  Reset();
+  net_->add_before_forward(&before_forward_);
+  net_->add_after_forward(&after_forward_);
+}
+
+template <typename Dtype>
+NetProfiler<Dtype>::~NetProfiler() {
+  net_->remove_before_forward(&before_forward_);
+  net_->remove_after_forward(&after_forward_);
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Reset() {
+  layer_stats_.assign(net_->layers().size(), LayerStats());
+  for (int i = 0; i < layer_stats_.size(); ++i) {
+    layer_stats_[i].histogram.resize(kHistogramBuckets, 0);
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  trace_.clear();
+  epoch_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Begin(int layer) {
+  if (calls_seen_[layer] % sample_period_ == 0) {
+    starts_[layer] = boost::posix_time::microsec_clock::universal_time();
+  }
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::End(int layer) {
+  if (calls_seen_[layer]++ % sample_period_ != 0) { return; }
+  const boost::posix_time::ptime end =
+      boost::posix_time::microsec_clock::universal_time();
+  const int64_t duration_us = (end - starts_[layer]).total_microseconds();
+  const double flops = LayerFlops(layer);
+  const double bytes = LayerBytes(layer);
+  LayerStats& stats = layer_stats_[layer];
+  stats.min_us = stats.calls ?
+      std::min<double>(stats.min_us, duration_us) : duration_us;
+  stats.max_us = std::max<double>(stats.max_us, duration_us);
+  ++stats.calls;
+  stats.total_us += duration_us;
+  stats.flops += flops;
+  stats.bytes += bytes;
+  int bucket = 0;
+  while (bucket + 1 < kHistogramBuckets && duration_us >= (1LL << bucket)) {
+    ++bucket;
+  }
+  ++stats.histogram[bucket];
+  boost::mutex::scoped_lock lock(*mutex_);
+  if (trace_.size() >= max_trace_events_) { return; }
+  ostringstream thread_name;
+  thread_name << boost::this_thread::get_id();
+  map<string, int>::iterator thread =
+      thread_ids_.insert(make_pair(thread_name.str(),
+      static_cast<int>(thread_ids_.size()))).first;
+  TraceEvent event;
+  event.layer = layer;
+  event.thread = thread->second;
+  event.start_us = (starts_[layer] - epoch_).total_microseconds();
+  event.duration_us = duration_us;
+  event.flops = flops;
+  event.bytes = bytes;
+  trace_.push_back(event);
+}
+
+template <typename Dtype>
+double NetProfiler<Dtype>::LayerFlops(int layer) const {
+  Layer<Dtype>* const layer_ptr = net_->layers()[layer].get();
+  const vector<Blob<Dtype>*>& bottom = net_->bottom_vecs()[layer];
+  const vector<Blob<Dtype>*>& top = net_->top_vecs()[layer];
+  const string type = layer_ptr->type();
+  double flops = 0;
+  if ((type == "Convolution" || type == "InnerProduct") &&
+      layer_ptr->blobs().size()) {
+    // Each output takes one multiply-add per weight of its output channel.
+    const double weights = layer_ptr->blobs()[0]->count();
+    const LayerParameter& param = layer_ptr->layer_param();
+    const int num_output = type == "Convolution" ?
+        param.convolution_param().num_output() :
+        param.inner_product_param().num_output();
+    flops = 2 * weights / num_output * top[0]->count();
+  } else if (type == "Deconvolution" && layer_ptr->blobs().size()) {
+    // Each input spreads over the weights of its input channel.
+    const double weights = layer_ptr->blobs()[0]->count();
+    flops = 2 * weights / layer_ptr->blobs()[0]->shape(0) *
+        bottom[0]->count();
+  } else {
+    for (int i = 0; i < top.size(); ++i) {
+      flops += top[i]->count();
+    }
+  }
+  return flops;
+}
+
+template <typename Dtype>
+double NetProfiler<Dtype>::LayerBytes(int layer) const {
+  const vector<Blob<Dtype>*>& bottom = net_->bottom_vecs()[layer];
+  const vector<Blob<Dtype>*>& top = net_->top_vecs()[layer];
+  const vector<shared_ptr<Blob<Dtype> > >& params =
+      net_->layers()[layer]->blobs();
+  double count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    count += bottom[i]->count();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    // In-place layers read and write the same blob.
+    if (std::find(bottom.begin(), bottom.end(), top[i]) == bottom.end()) {
+      count += top[i]->count();
+    }
+  }
+  for (int i = 0; i < params.size(); ++i) {
+    count += params[i]->count();
+  }
+  return count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteChromeTrace(std::ostream* out) const {
+  const vector<string>& layer_names = net_->layer_names();
+  boost::mutex::scoped_lock lock(*mutex_);
+  *out << "{\"traceEvents\":[";
+  for (int i = 0; i < trace_.size(); ++i) {
+    const TraceEvent& event = trace_[i];
+    *out << (i ? ",\n" : "\n") << "{\"name\":"
+        << JsonString(layer_names[event.layer]) << ",\"cat\":"
+        << JsonString(net_->layers()[event.layer]->type())
+        << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+        << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us
+        << ",\"args\":{\"flops\":" << event.flops << ",\"bytes\":"
+        << event.bytes << "}}";
+  }
+  *out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteHistograms(std::ostream* out) const {
+  const vector<string>& layer_names = net_->layer_names();
+  *out << "{\"sample_period\":" << sample_period_ << ",\"layers\":[";
+  for (int i = 0; i < layer_stats_.size(); ++i) {
+    const LayerStats& stats = layer_stats_[i];
+    *out << (i ? ",\n" : "\n") << "{\"name\":" << JsonString(layer_names[i])
+        << ",\"type\":" << JsonString(net_->layers()[i]->type())
+        << ",\"calls\":" << stats.calls << ",\"total_us\":" << stats.total_us
+        << ",\"min_us\":" << stats.min_us << ",\"max_us\":" << stats.max_us
+        << ",\"flops\":" << stats.flops << ",\"bytes\":" << stats.bytes
+        << ",\"histogram_us\":[";
+    for (int b = 0; b < stats.histogram.size(); ++b) {
+      *out << (b ? "," : "") << stats.histogram[b];
+    }
+    *out << "]}";
+  }
+  *out << "\n]}\n";
+}
+
+INSTANTIATE_CLASS(NetProfiler);
+
+}  // namespace caffe
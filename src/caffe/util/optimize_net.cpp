@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/optimize_net.hpp"
+
+namespace caffe {
+
+namespace {
+
+bool IsPassThrough(const LayerParameter& layer_param) {
+  return (layer_param.type() == "Dropout" || layer_param.type() == "Split")
+      && layer_param.bottom_size() == 1;
+}
+
+// Indices of the layers after layer_idx that read blob_name as produced by
+// layer_idx, stopping where a layer redefines it. Layers marked in skip are
+// ignored.
+vector<int> Consumers(const NetParameter& param, const int layer_idx,
+    const string& blob_name, const vector<bool>& skip) {
+  vector<int> consumers;
+  for (int i = layer_idx + 1; i < param.layer_size(); ++i) {
+    if (skip[i]) { continue; }
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (layer_param.bottom(j) == blob_name) {
+        consumers.push_back(i);
+        break;
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      if (layer_param.top(j) == blob_name) {
+        return consumers;
+      }
+    }
+  }
+  return consumers;
+}
+
+// Whether the pass-through layer at layer_idx can go, given the aliases of
+// the layers removed before it: each top must be the bottom itself or be read
+// by some later layer, and once the bottom and the tops share one blob, none
+// of them may be read after another one has written to it.
+bool CanRemove(const NetParameter& param, const int layer_idx,
+    const map<string, string>& alias) {
+  const LayerParameter& layer_param = param.layer(layer_idx);
+  const vector<bool> none(param.layer_size(), false);
+  for (int j = 0; j < layer_param.top_size(); ++j) {
+    if (layer_param.top(j) == layer_param.bottom(0)) { continue; }
+    if (Consumers(param, layer_idx, layer_param.top(j), none).empty()) {
+      return false;
+    }
+  }
+  // The names that would share the blob named merged.
+  map<string, string>::const_iterator bottom_alias =
+      alias.find(layer_param.bottom(0));
+  const string merged = bottom_alias == alias.end() ?
+      layer_param.bottom(0) : bottom_alias->second;
+  set<string> names(layer_param.top().begin(), layer_param.top().end());
+  names.insert(merged);
+  for (map<string, string>::const_iterator it = alias.begin();
+       it != alias.end(); ++it) {
+    if (it->second == merged) { names.insert(it->first); }
+  }
+  // Any write to merged itself, and in-place writes to the other names, go
+  // to the shared blob; other writes give a name a blob of its own again.
+  // Pass-through layers working in place leave the values as they are.
+  string writer;
+  for (int i = layer_idx + 1; i < param.layer_size(); ++i) {
+    const LayerParameter& other = param.layer(i);
+    if (IsPassThrough(other) && other.top_size() == 1 &&
+        other.top(0) == other.bottom(0)) {
+      continue;
+    }
+    for (int j = 0; j < other.bottom_size(); ++j) {
+      if (names.count(other.bottom(j)) && !writer.empty() &&
+          other.bottom(j) != writer) {
+        return false;
+      }
+    }
+    for (int j = 0; j < other.top_size(); ++j) {
+      const string& name = other.top(j);
+      if (!names.count(name)) { continue; }
+      if (name == merged ||
+          (j < other.bottom_size() && other.bottom(j) == name)) {
+        writer = name;
+      } else {
+        names.erase(name);
+      }
+    }
+  }
+  return true;
+}
+
+// The per-channel y = scale * x + shift computed by a BatchNorm or Scale
+// layer at test time, or false if the layer is not such a transform of the
+// given number of channels.
+bool ChannelAffine(const LayerParameter& layer_param, const int channels,
+    vector<double>* scale, vector<double>* shift) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  scale->assign(channels, 1);
+  shift->assign(channels, 0);
+  if (layer_param.type() == "BatchNorm") {
+    const BatchNormParameter& bn_param = layer_param.batch_norm_param();
+    if ((bn_param.has_use_global_stats() && !bn_param.use_global_stats()) ||
+        layer_param.blobs_size() != 3) {
+      return false;
+    }
+    Blob<double> mean, variance, scale_factor;
+    mean.FromProto(layer_param.blobs(0));
+    variance.FromProto(layer_param.blobs(1));
+    scale_factor.FromProto(layer_param.blobs(2));
+    if (mean.count() != channels || variance.count() != channels) {
+      return false;
+    }
+    // Same as BatchNormLayer::Forward_cpu with use_global_stats.
+    const double factor = scale_factor.cpu_data()[0] == 0 ?
+        0 : 1 / scale_factor.cpu_data()[0];
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = 1 / std::sqrt(variance.cpu_data()[c] * factor +
+          bn_param.eps());
+      (*shift)[c] = -mean.cpu_data()[c] * factor * (*scale)[c];
+    }
+    return true;
+  }
+  if (layer_param.type() == "Scale") {
+    const ScaleParameter& scale_param = layer_param.scale_param();
+    if (scale_param.axis() != 1 || scale_param.num_axes() != 1 ||
+        layer_param.blobs_size() != (scale_param.bias_term() ? 2 : 1)) {
+      return false;
+    }
+    Blob<double> gamma;
+    gamma.FromProto(layer_param.blobs(0));
+    if (gamma.count() != channels) {
+      return false;
+    }
+    Blob<double> beta;
+    if (scale_param.bias_term()) {
+      beta.FromProto(layer_param.blobs(1));
+      CHECK_EQ(beta.count(), channels);
+    }
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = gamma.cpu_data()[c];
+      (*shift)[c] = scale_param.bias_term() ? beta.cpu_data()[c] : 0;
+    }
+    return true;
+  }
+  return false;
+}
+
+// Whether layer_param is a Convolution or InnerProduct with trained blobs
+// whose output channels are axis 1 and the rows of its weights.
+bool CanFoldInto(const LayerParameter& layer_param) {
+  if (layer_param.top_size() != 1 || layer_param.blobs_size() == 0) {
+    return false;
+  }
+  if (layer_param.type() == "Convolution") {
+    return layer_param.convolution_param().axis() == 1;
+  }
+  if (layer_param.type() == "InnerProduct") {
+    const InnerProductParameter& ip_param = layer_param.inner_product_param();
+    return ip_param.axis() == 1 && !ip_param.transpose();
+  }
+  return false;
+}
+
+// Write blob into proto at the given precision, replacing its contents.
+void WriteBlob(const Blob<double>& blob, const bool as_double,
+    BlobProto* proto) {
+  proto->Clear();
+  if (as_double) {
+    blob.ToProto(proto);
+    return;
+  }
+  Blob<float> single(blob.shape());
+  for (int i = 0; i < blob.count(); ++i) {
+    single.mutable_cpu_data()[i] = blob.cpu_data()[i];
+  }
+  single.ToProto(proto);
+}
+
+// Apply y = scale * x + shift per output channel to the weights and bias of
+// a Convolution or InnerProduct, adding a bias if it has none.
+void FoldAffine(const vector<double>& scale, const vector<double>& shift,
+    LayerParameter* layer_param) {
+  const bool has_bias = layer_param->type() == "Convolution" ?
+      layer_param->convolution_param().bias_term() :
+      layer_param->inner_product_param().bias_term();
+  // Keep the precision the weights were saved in.
+  const bool as_double = layer_param->blobs(0).double_data_size() > 0;
+  Blob<double> weights;
+  weights.FromProto(layer_param->blobs(0));
+  const int channels = weights.shape(0);
+  const int dim = weights.count(1);
+  double* weight_data = weights.mutable_cpu_data();
+  for (int c = 0; c < channels; ++c) {
+    for (int i = 0; i < dim; ++i) {
+      weight_data[c * dim + i] *= scale[c];
+    }
+  }
+  WriteBlob(weights, as_double, layer_param->mutable_blobs(0));
+  Blob<double> bias(vector<int>(1, channels));
+  if (has_bias) {
+    bias.FromProto(layer_param->blobs(1));
+  } else {
+    caffe_set(channels, 0., bias.mutable_cpu_data());
+    layer_param->add_blobs();
+    if (layer_param->type() == "Convolution") {
+      layer_param->mutable_convolution_param()->set_bias_term(true);
+    } else {
+      layer_param->mutable_inner_product_param()->set_bias_term(true);
+    }
+  }
+  double* bias_data = bias.mutable_cpu_data();
+  for (int c = 0; c < channels; ++c) {
+    bias_data[c] = bias_data[c] * scale[c] + shift[c];
+  }
+  WriteBlob(bias, as_double, layer_param->mutable_blobs(1));
+}
+
+}  // namespace
+
+void OptimizeNetForInference(const NetParameter& param,
+    NetParameter* param_optimized) {
+  // Drop the pass-through layers, renaming their tops to their bottom in
+  // the layers that follow.
+  NetParameter passed;
+  passed.CopyFrom(param);
+  passed.clear_layer();
+  map<string, string> alias;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& source = param.layer(i);
+    LayerParameter layer_param(source);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (alias.count(layer_param.bottom(j))) {
+        layer_param.set_bottom(j, alias[layer_param.bottom(j)]);
+      }
+    }
+    if (IsPassThrough(source) && CanRemove(param, i, alias)) {
+      for (int j = 0; j < source.top_size(); ++j) {
+        if (source.top(j) != source.bottom(0)) {
+          alias[source.top(j)] = layer_param.bottom(0);
+        }
+      }
+      LOG(INFO) << "Removing " << source.type() << " layer " << source.name();
+      continue;
+    }
+    for (int j = 0; j < source.top_size(); ++j) {
+      if (j < source.bottom_size() && source.top(j) == source.bottom(j)) {
+        layer_param.set_top(j, layer_param.bottom(j));
+      } else {
+        alias.erase(source.top(j));
+      }
+    }
+    passed.add_layer()->CopyFrom(layer_param);
+  }
+
+  // Fold chains of BatchNorm and Scale into the layer that feeds them, as
+  // long as each is the only reader of its input.
+  vector<bool> folded(passed.layer_size(), false);
+  for (int i = 0; i < passed.layer_size(); ++i) {
+    LayerParameter* layer_param = passed.mutable_layer(i);
+    if (folded[i] || !CanFoldInto(*layer_param)) { continue; }
+    Blob<double> weights;
+    weights.FromProto(layer_param->blobs(0));
+    const int channels = weights.shape(0);
+    for (;;) {
+      const vector<int> consumers =
+          Consumers(passed, i, layer_param->top(0), folded);
+      if (consumers.size() != 1) { break; }
+      const LayerParameter& next = passed.layer(consumers[0]);
+      vector<double> scale, shift;
+      if (!ChannelAffine(next, channels, &scale, &shift)) { break; }
+      FoldAffine(scale, shift, layer_param);
+      layer_param->set_top(0, next.top(0));
+      folded[consumers[0]] = true;
+      LOG(INFO) << "Folding " << next.type() << " layer " << next.name()
+                << " into " << layer_param->name();
+    }
+  }
+  param_optimized->CopyFrom(passed);
+  param_optimized->clear_layer();
+  for (int i = 0; i < passed.layer_size(); ++i) {
+    if (!folded[i]) {
+      param_optimized->add_layer()->CopyFrom(passed.layer(i));
+    }
+  }
+}
+
+}  // namespace caffe
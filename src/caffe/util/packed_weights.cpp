@@ -0,0 +1,127 @@
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "caffe/util/packed_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The last packing of each weight memory, for every Update that reads it to
+// share. Neither the memory nor the packing is kept alive by the cache.
+struct CachedPacking {
+  boost::weak_ptr<SyncedMemory> source;
+  int version;
+  boost::weak_ptr<void> packing;
+};
+
+boost::mutex cache_mutex;
+map<const SyncedMemory*, CachedPacking> cache;
+
+}  // namespace
+
+template <typename Dtype>
+void PackedWeights<Dtype>::Packing::Pack(const Dtype* data) {
+  group_count = caffe_cpu_gemm_packed_count(rows, cols);
+  const int count = num_groups * group_count;
+  std::vector<Dtype> transpose;
+  std::vector<Dtype> panels(count);
+  for (int g = 0; g < num_groups; ++g) {
+    const Dtype* group = data + g * rows * cols;
+    if (transposed) {
+      transpose.resize(rows * cols);
+      for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+          transpose[r * cols + c] = group[c * rows + r];
+        }
+      }
+      group = &transpose[0];
+    }
+    caffe_cpu_gemm_pack(rows, cols, group, &panels[0] + g * group_count);
+  }
+  if (precision == FLOAT32) {
+    packed.swap(panels);
+  } else {
+    half.resize(count);
+    ToHalf(count, &panels[0], half_format(), &half[0]);
+  }
+}
+
+template <typename Dtype>
+void PackedWeights<Dtype>::Packing::Restore(void* data) const {
+  Dtype* weights = static_cast<Dtype*>(data);
+  std::vector<Dtype> panel(kGemmPanelRows * cols);
+  for (int g = 0; g < num_groups; ++g) {
+    Dtype* group = weights + g * rows * cols;
+    for (int row = 0; row < rows; row += kGemmPanelRows) {
+      const int offset = g * group_count + row * cols;
+      if (precision == FLOAT32) {
+        std::copy(&packed[offset], &packed[offset] + panel.size(),
+            panel.begin());
+      } else {
+        FromHalf(panel.size(), &half[offset], half_format(), &panel[0]);
+      }
+      for (int r = row; r < std::min(rows, row + kGemmPanelRows); ++r) {
+        for (int c = 0; c < cols; ++c) {
+          const Dtype value = panel[c * kGemmPanelRows + r - row];
+          if (transposed) {
+            group[c * rows + r] = value;
+          } else {
+            group[r * cols + c] = value;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PackedWeights<Dtype>::Update(const Blob<Dtype>& weights, int num_groups,
+    int rows, int cols, bool transposed, Precision precision) {
+  const shared_ptr<SyncedMemory>& memory = weights.data();
+  if (packing_ && IsSource(memory) && memory->version() == version_ &&
+      packing_->Matches(num_groups, rows, cols, transposed, precision)) {
+    return;
+  }
+  CHECK_EQ(weights.count(), num_groups * rows * cols);
+  boost::mutex::scoped_lock lock(cache_mutex);
+  for (map<const SyncedMemory*, CachedPacking>::iterator it = cache.begin();
+       it != cache.end(); ) {
+    if (it->second.packing.expired()) {
+      cache.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  CachedPacking& cached = cache[memory.get()];
+  shared_ptr<Packing> packing =
+      boost::static_pointer_cast<Packing>(cached.packing.lock());
+  if (!packing || cached.source.lock() != memory ||
+      cached.version != memory->version() ||
+      !packing->Matches(num_groups, rows, cols, transposed, precision)) {
+    packing.reset(new Packing());
+    packing->num_groups = num_groups;
+    packing->rows = rows;
+    packing->cols = cols;
+    packing->transposed = transposed;
+    packing->precision = precision;
+    packing->Pack(weights.cpu_data());
+    cached.source = memory;
+    cached.version = memory->version();
+    cached.packing = packing;
+  }
+  if (release_weights_ && precision != FLOAT32 && memory.use_count() == 1) {
+    memory->release_cpu_data(packing);
+  }
+  packing_ = packing;
+  source_ = memory;
+  version_ = memory->version();
+}
+
+INSTANTIATE_CLASS(PackedWeights);
+
+}  // namespace caffe
@@ -0,0 +1,115 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads), region_mutex_(new boost::mutex()),
+      mutex_(new boost::mutex()),
+      work_condition_(new boost::condition_variable_any()),
+      done_condition_(new boost::condition_variable_any()), stop_(false),
+      generation_(0), body_(NULL), begin_(0), end_(0), num_chunks_(0),
+      next_chunk_(0), pending_chunks_(0) {
+  CHECK_GE(num_threads, 1);
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&ThreadPool::WorkerLoop, this)));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stop_ = true;
+  }
+  work_condition_->notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain,
+    const boost::function<void(int, int)>& body) {
+  const int count = end - begin;
+  if (count <= 0) { return; }
+  const int num_chunks =
+      std::min(num_threads_, std::max(1, count / std::max(grain, 1)));
+  if (num_chunks == 1) {
+    body(begin, end);
+    return;
+  }
+  boost::mutex::scoped_try_lock region(*region_mutex_);
+  if (!region.owns_lock()) {
+    body(begin, end);
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    body_ = &body;
+    begin_ = begin;
+    end_ = end;
+    num_chunks_ = num_chunks;
+    next_chunk_ = 0;
+    pending_chunks_ = num_chunks;
+    ++generation_;
+  }
+  work_condition_->notify_all();
+  RunChunks();
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (pending_chunks_ > 0) {
+    done_condition_->wait(lock);
+  }
+  body_ = NULL;
+}
+
+void ThreadPool::RunChunks() {
+  for (;;) {
+    const boost::function<void(int, int)>* body;
+    int chunk_begin, chunk_end;
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      if (body_ == NULL || next_chunk_ == num_chunks_) { return; }
+      const int64_t count = end_ - begin_;
+      chunk_begin = begin_ + count * next_chunk_ / num_chunks_;
+      chunk_end = begin_ + count * (next_chunk_ + 1) / num_chunks_;
+      ++next_chunk_;
+      body = body_;
+    }
+    (*body)(chunk_begin, chunk_end);
+    boost::mutex::scoped_lock lock(*mutex_);
+    if (--pending_chunks_ == 0) {
+      done_condition_->notify_all();
+    }
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  int generation = 0;
+  for (;;) {
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      while (!stop_ && generation_ == generation) {
+        work_condition_->wait(lock);
+      }
+      if (stop_) { return; }
+      generation = generation_;
+    }
+    RunChunks();
+  }
+}
+
+void ParallelFor(int begin, int end, int grain,
+    const boost::function<void(int, int)>& body) {
+  ThreadPool* pool = Caffe::thread_pool();
+  if (pool) {
+    pool->ParallelFor(begin, end, grain, body);
+  } else if (begin < end) {
+    body(begin, end);
+  }
+}
+
+}  // namespace caffe
@@ -6,13 +6,19 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/cpu_kernels.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -48,6 +54,25 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(threads, 1,
+    "Optional; the number of threads CPU layers split their work over.");
+DEFINE_bool(forward_only, false,
+    "Optional; time only the forward pass, of the TEST phase unless --phase "
+    "is given.");
+DEFINE_int32(warmup, 1,
+    "Optional; the number of untimed iterations to run before timing.");
+DEFINE_string(shapes, "",
+    "Optional; the shapes of the first input blob to time in turn, such as "
+    "the scales of an image pyramid, separated by ';', each as dims "
+    "separated by ','.");
+DEFINE_string(batch_sizes, "",
+    "Optional; the batch sizes to time each input shape with, separated by "
+    "','.");
+DEFINE_int32(clones, 1,
+    "Optional; the number of clones of the net to time at once, each on a "
+    "thread of its own with --threads threads; needs --forward_only.");
+DEFINE_string(json, "",
+    "Optional; the file to write the timings to as JSON.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -276,8 +301,10 @@ int test() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << FLAGS_threads << " thread(s) and "
+        << caffe::cpu_level_name(caffe::cpu_level()) << " kernels.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
@@ -330,11 +357,186 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Forward callbacks that time every layer of a net, in ms.
+class LayerTimer {
+ public:
+  explicit LayerTimer(Net<float>* net)
+      : net_(net), before_(this, true), after_(this, false),
+        timers_(net->layers().size()), times_(net->layers().size()),
+        recording_(false) {
+    for (int i = 0; i < timers_.size(); ++i) {
+      timers_[i].reset(new Timer());
+    }
+    net_->add_before_forward(&before_);
+    net_->add_after_forward(&after_);
+  }
+  ~LayerTimer() {
+    net_->remove_before_forward(&before_);
+    net_->remove_after_forward(&after_);
+  }
+
+  void set_recording(bool value) { recording_ = value; }
+  // One time per recorded call of each layer.
+  const vector<vector<double> >& times() const { return times_; }
+
+ private:
+  class Hook : public Net<float>::Callback {
+   public:
+    Hook(LayerTimer* timer, bool before) : timer_(timer), before_(before) {}
+
+   protected:
+    virtual void run(int layer) {
+      if (!timer_->recording_) { return; }
+      if (before_) {
+        timer_->timers_[layer]->Start();
+      } else {
+        timer_->times_[layer].push_back(
+            timer_->timers_[layer]->MicroSeconds() / 1000);
+      }
+    }
+
+   private:
+    LayerTimer* timer_;
+    bool before_;
+  };
+
+  Net<float>* net_;
+  Hook before_;
+  Hook after_;
+  vector<shared_ptr<Timer> > timers_;
+  vector<vector<double> > times_;
+  bool recording_;
+};
+
+// The times of the timed iterations of one or more nets, in ms.
+struct RunTimes {
+  RunTimes() : throughput(0) {}
+  // Iterations per second.
+  double throughput;
+  vector<double> forward;
+  vector<double> backward;
+  vector<vector<double> > layer_forward;
+  vector<vector<double> > layer_backward;
+};
+
+// Run --warmup untimed and then --iterations timed iterations of net.
+static void time_net(Net<float>* net, RunTimes* times) {
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = net->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = net->top_vecs();
+  const vector<vector<bool> >& bottom_need_backward =
+      net->bottom_need_backward();
+  LayerTimer layer_timer(net);
+  times->layer_backward.resize(layers.size());
+  Timer timer;
+  Timer timed_timer;
+  for (int j = 0; j < FLAGS_warmup + FLAGS_iterations; ++j) {
+    const bool timed = j >= FLAGS_warmup;
+    if (j == FLAGS_warmup) { timed_timer.Start(); }
+    layer_timer.set_recording(timed);
+    timer.Start();
+    net->Forward();
+    if (timed) { times->forward.push_back(timer.MicroSeconds() / 1000); }
+    if (FLAGS_forward_only) { continue; }
+    Timer backward_timer;
+    backward_timer.Start();
+    for (int i = layers.size() - 1; i >= 0; --i) {
+      timer.Start();
+      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
+                          bottom_vecs[i]);
+      if (timed) {
+        times->layer_backward[i].push_back(timer.MicroSeconds() / 1000);
+      }
+    }
+    if (timed) {
+      times->backward.push_back(backward_timer.MicroSeconds() / 1000);
+    }
+  }
+  times->throughput = 1e6 * FLAGS_iterations /
+      std::max(timed_timer.MicroSeconds(), 1.f);
+  times->layer_forward = layer_timer.times();
+}
+
+// time_net on a thread of its own, for --clones.
+static void time_clone(Net<float>* net, int device, RunTimes* times) {
+  if (device >= 0) {
+    Caffe::SetDevice(device);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
+  }
+  time_net(net, times);
+}
+
+// Parse a list of ints separated by delimiters.
+static vector<int> parse_ints(const string& value, const char* delimiters) {
+  vector<string> strings;
+  boost::split(strings, value, boost::is_any_of(delimiters));
+  vector<int> ints;
+  for (int i = 0; i < strings.size(); ++i) {
+    ints.push_back(boost::lexical_cast<int>(strings[i]));
+  }
+  return ints;
+}
+
+// The mean and percentiles of times, by nearest rank.
+struct TimeStats {
+  explicit TimeStats(vector<double> times)
+      : mean(0), p50(0), p95(0), p99(0) {
+    if (times.empty()) { return; }
+    std::sort(times.begin(), times.end());
+    for (int i = 0; i < times.size(); ++i) {
+      mean += times[i] / times.size();
+    }
+    p50 = percentile(times, 50);
+    p95 = percentile(times, 95);
+    p99 = percentile(times, 99);
+  }
+  static double percentile(const vector<double>& sorted, int p) {
+    const int rank = (p * sorted.size() + 99) / 100;
+    return sorted[std::max(rank, 1) - 1];
+  }
+  double mean;
+  double p50;
+  double p95;
+  double p99;
+};
+
+static std::ostream& operator<<(std::ostream& out, const TimeStats& stats) {
+  return out << stats.mean << " ms (p50 " << stats.p50 << ", p95 "
+      << stats.p95 << ", p99 " << stats.p99 << ")";
+}
+
+static string json_stats(const TimeStats& stats) {
+  ostringstream json;
+  json << "{\"mean\":" << stats.mean << ",\"p50\":" << stats.p50
+      << ",\"p95\":" << stats.p95 << ",\"p99\":" << stats.p99 << "}";
+  return json.str();
+}
+
+static string json_string(const string& value) {
+  ostringstream json;
+  json << '"';
+  for (int i = 0; i < value.size(); ++i) {
+    if (value[i] == '"' || value[i] == '\\') { json << '\\'; }
+    json << value[i];
+  }
+  json << '"';
+  return json.str();
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
-  caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
+  CHECK_GE(FLAGS_warmup, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+  CHECK_GT(FLAGS_clones, 0);
+  caffe::Phase phase =
+      get_phase_from_flags(FLAGS_forward_only ? caffe::TEST : caffe::TRAIN);
   vector<string> stages = get_stages_from_flags();
+  CHECK(FLAGS_clones == 1 || (FLAGS_forward_only && phase == caffe::TEST))
+      << "Clones are timed forward only, in the TEST phase.";
 
   // Set device id and mode
   vector<int> gpus;
@@ -344,79 +546,179 @@ int time() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << FLAGS_threads << " thread(s) and "
+        << caffe::cpu_level_name(caffe::cpu_level()) << " kernels.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
   }
-  // Instantiate the caffe net.
+  // Instantiate the caffe net, timing how long it takes to serve a first
+  // inference from scratch.
+  Timer startup_timer;
+  startup_timer.Start();
   Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  const double init_time = startup_timer.MicroSeconds() / 1000;
+  double weights_time = 0;
+  if (FLAGS_weights.size()) {
+    startup_timer.Start();
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+    weights_time = startup_timer.MicroSeconds() / 1000;
+  }
 
-  // Do a clean forward and backward pass, so that memory allocation are done
-  // and future iterations will be more stable.
+  // Do a clean forward (and backward) pass, so that memory allocation are
+  // done and future iterations will be more stable.
   LOG(INFO) << "Performing Forward";
   // Note that for the speed benchmark, we will assume that the network does
   // not take any input blobs.
   float initial_loss;
+  startup_timer.Start();
   caffe_net.Forward(&initial_loss);
+  const double first_forward_time = startup_timer.MicroSeconds() / 1000;
   LOG(INFO) << "Initial loss: " << initial_loss;
-  LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
+  const double first_inference_time =
+      init_time + weights_time + first_forward_time;
+  LOG(INFO) << "Time to first inference: " << first_inference_time
+      << " ms (init: " << init_time << " ms, weights: " << weights_time
+      << " ms, first forward: " << first_forward_time << " ms).";
+  if (!FLAGS_forward_only) {
+    LOG(INFO) << "Performing Backward";
+    caffe_net.Backward();
+  }
+
+  // The nets timed concurrently.
+  vector<shared_ptr<Net<float> > > clones;
+  for (int i = 1; i < FLAGS_clones; ++i) {
+    clones.push_back(caffe_net.CloneForInference());
+  }
+  vector<Net<float>*> nets(1, &caffe_net);
+  for (int i = 0; i < clones.size(); ++i) {
+    nets.push_back(clones[i].get());
+  }
+
+  // The input shapes to time: the swept ones, or those of the model.
+  vector<vector<int> > input_shapes;
+  if (FLAGS_shapes.size() || FLAGS_batch_sizes.size()) {
+    CHECK_GT(caffe_net.input_blobs().size(), 0)
+        << "Sweeping shapes needs a net with inputs.";
+    vector<string> shapes;
+    if (FLAGS_shapes.size()) {
+      boost::split(shapes, FLAGS_shapes, boost::is_any_of(";"));
+    }
+    for (int i = 0; i < std::max<int>(shapes.size(), 1); ++i) {
+      const vector<int> shape = shapes.size() ? parse_ints(shapes[i], ",") :
+          caffe_net.input_blobs()[0]->shape();
+      if (FLAGS_batch_sizes.empty()) {
+        input_shapes.push_back(shape);
+        continue;
+      }
+      const vector<int> batch_sizes = parse_ints(FLAGS_batch_sizes, ",");
+      for (int j = 0; j < batch_sizes.size(); ++j) {
+        input_shapes.push_back(shape);
+        input_shapes.back()[0] = batch_sizes[j];
+      }
+    }
+  } else {
+    input_shapes.push_back(caffe_net.input_blobs().size() ?
+        caffe_net.input_blobs()[0]->shape() : vector<int>());
+  }
 
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
+  ostringstream json;
+  json << "{\"model\":" << json_string(FLAGS_model)
+      << ",\"mode\":\"" << (gpus.size() ? "GPU" : "CPU") << "\""
+      << ",\"threads\":" << FLAGS_threads << ",\"clones\":" << FLAGS_clones
+      << ",\"forward_only\":" << (FLAGS_forward_only ? "true" : "false")
+      << ",\"warmup\":" << FLAGS_warmup
+      << ",\"iterations\":" << FLAGS_iterations
+      << ",\"time_to_first_inference_ms\":{\"total\":" << first_inference_time
+      << ",\"init\":" << init_time << ",\"weights\":" << weights_time
+      << ",\"first_forward\":" << first_forward_time << "}"
+      << ",\"runs\":[";
   LOG(INFO) << "*** Benchmark begins ***";
-  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
-  Timer total_timer;
-  total_timer.Start();
-  Timer forward_timer;
-  Timer backward_timer;
-  Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
-  for (int j = 0; j < FLAGS_iterations; ++j) {
-    Timer iter_timer;
-    iter_timer.Start();
-    forward_timer.Start();
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations after "
+      << FLAGS_warmup << " warm-up iteration(s), on " << FLAGS_clones
+      << " net(s) at once.";
+  for (int s = 0; s < input_shapes.size(); ++s) {
+    const vector<int>& input_shape = input_shapes[s];
+    if (input_shape.size()) {
+      for (int i = 0; i < nets.size(); ++i) {
+        nets[i]->input_blobs()[0]->Reshape(input_shape);
+        nets[i]->Reshape();
+      }
+      LOG(INFO) << "Input shape: "
+          << caffe_net.input_blobs()[0]->shape_string();
+    }
+    vector<RunTimes> clone_times(nets.size());
+    Timer total_timer;
+    total_timer.Start();
+    if (nets.size() == 1) {
+      time_net(&caffe_net, &clone_times[0]);
+    } else {
+      boost::thread_group threads;
+      for (int i = 0; i < nets.size(); ++i) {
+        threads.create_thread(boost::bind(&time_clone, nets[i],
+            gpus.size() ? gpus[0] : -1, &clone_times[i]));
+      }
+      threads.join_all();
+    }
+    const double total_time = total_timer.MicroSeconds() / 1000;
+    // Pool the samples of all nets.
+    RunTimes times = clone_times[0];
+    for (int i = 1; i < clone_times.size(); ++i) {
+      times.throughput += clone_times[i].throughput;
+      times.forward.insert(times.forward.end(),
+          clone_times[i].forward.begin(), clone_times[i].forward.end());
+      for (int l = 0; l < layers.size(); ++l) {
+        times.layer_forward[l].insert(times.layer_forward[l].end(),
+            clone_times[i].layer_forward[l].begin(),
+            clone_times[i].layer_forward[l].end());
+      }
+    }
+    const int batch_size = input_shape.size() ? input_shape[0] : 1;
+    const double throughput = times.throughput * batch_size;
+
+    json << (s ? "," : "") << "{\"input_shape\":[";
+    for (int i = 0; i < input_shape.size(); ++i) {
+      json << (i ? "," : "") << input_shape[i];
+    }
+    json << "],\"forward_ms\":" << json_stats(TimeStats(times.forward));
+    if (!FLAGS_forward_only) {
+      json << ",\"backward_ms\":" << json_stats(TimeStats(times.backward));
+    }
+    json << ",\"throughput_per_s\":" << throughput << ",\"layers\":[";
+    LOG(INFO) << "Time per layer: ";
     for (int i = 0; i < layers.size(); ++i) {
-      timer.Start();
-      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+      const caffe::string& layername = layers[i]->layer_param().name();
+      // Layers fused into the one before them do not run on their own and
+      // show as 0 ms.
+      const TimeStats forward_stats(times.layer_forward[i]);
+      LOG(INFO) << std::setfill(' ') << std::setw(10) << layername
+          << "\tforward: " << forward_stats << ".";
+      json << (i ? "," : "") << "{\"name\":" << json_string(layername)
+          << ",\"type\":" << json_string(layers[i]->type())
+          << ",\"forward_ms\":" << json_stats(forward_stats);
+      if (!FLAGS_forward_only) {
+        const TimeStats backward_stats(times.layer_backward[i]);
+        LOG(INFO) << std::setfill(' ') << std::setw(10) << layername
+            << "\tbackward: " << backward_stats << ".";
+        json << ",\"backward_ms\":" << json_stats(backward_stats);
+      }
+      json << "}";
     }
-    forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+    json << "]}";
+    LOG(INFO) << "Forward pass: " << TimeStats(times.forward) << ".";
+    if (!FLAGS_forward_only) {
+      LOG(INFO) << "Backward pass: " << TimeStats(times.backward) << ".";
     }
-    backward_time += backward_timer.MicroSeconds();
-    LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
-      << iter_timer.MilliSeconds() << " ms.";
-  }
-  LOG(INFO) << "Average time per layer: ";
-  for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-  }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+    LOG(INFO) << "Throughput: " << throughput << " inputs/s.";
+    LOG(INFO) << "Total Time: " << total_time << " ms.";
+  }
+  json << "]}\n";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_json.size()) {
+    std::ofstream json_file(FLAGS_json.c_str());
+    CHECK(json_file.good()) << "Cannot write " << FLAGS_json;
+    json_file << json.str();
+  }
   return 0;
 }
 RegisterBrewFunction(time);
@@ -0,0 +1,36 @@
+// This is a script to convert trained weights into a mapped weights file,
+// which nets map and share instead of parsing and copying; see
+// MappedWeights.
+// Usage:
+//    convert_mapped_weights weights_in weights_out.caffemap
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_mapped_weights weights_in "
+        << "weights_out.caffemap";
+    return 1;
+  }
+  const string output_filename(argv[2]);
+  if (!IsMappedWeightsFile(output_filename)) {
+    LOG(ERROR) << "The output must have the .caffemap extension for nets to "
+        << "recognize it: " << output_filename;
+    return 1;
+  }
+
+  NetParameter trained_param;
+  ReadNetParamsFromBinaryFileOrDie(string(argv[1]), &trained_param);
+  WriteMappedWeights(trained_param, output_filename);
+
+  LOG(INFO) << "Wrote mapped weights to " << output_filename;
+  return 0;
+}
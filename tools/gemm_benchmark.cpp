@@ -0,0 +1,85 @@
+// This program times the forward GEMMs of the MTCNN convolutions (det1 on a
+// 120 x 120 input, det2 and det3 on their crops) on BLAS and on the native
+// packed kernels that ConvolutionParameter.native_gemm selects.
+// Usage:
+//    gemm_benchmark [iterations]
+
+#include <cstdlib>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/cpu_kernels.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+struct GemmShape {
+  const char* name;
+  int M;  // Output channels.
+  int K;  // Input channels times the kernel area.
+  int N;  // Output pixels.
+};
+
+const GemmShape kShapes[] = {
+  {"det1 conv1", 10, 27, 118 * 118},
+  {"det1 conv2", 16, 90, 57 * 57},
+  {"det1 conv3", 32, 144, 55 * 55},
+  {"det1 conv4-1", 2, 32, 55 * 55},
+  {"det2 conv1", 28, 27, 22 * 22},
+  {"det2 conv2", 48, 252, 9 * 9},
+  {"det2 conv3", 64, 192, 3 * 3},
+  {"det3 conv1", 32, 27, 46 * 46},
+  {"det3 conv2", 64, 288, 21 * 21},
+  {"det3 conv3", 64, 576, 8 * 8},
+  {"det3 conv4", 128, 256, 3 * 3},
+};
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  const int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+  if (argc > 2 || iterations <= 0) {
+    LOG(ERROR) << "Usage: gemm_benchmark [iterations]";
+    return 1;
+  }
+  LOG(INFO) << "Native kernels at level " << cpu_level_name(cpu_level())
+            << ", " << iterations << " iterations per shape.";
+
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  CPUTimer timer;
+  for (int s = 0; s < sizeof(kShapes) / sizeof(kShapes[0]); ++s) {
+    const GemmShape& shape = kShapes[s];
+    Blob<float> a(std::vector<int>(1, shape.M * shape.K));
+    Blob<float> b(std::vector<int>(1, shape.K * shape.N));
+    Blob<float> c(std::vector<int>(1, shape.M * shape.N));
+    Blob<float> packed(std::vector<int>(1,
+        cpu_gemm_packed_count(shape.M, shape.K)));
+    filler.Fill(&a);
+    filler.Fill(&b);
+    cpu_gemm_pack(shape.M, shape.K, a.cpu_data(), packed.mutable_cpu_data());
+
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, shape.M, shape.N,
+          shape.K, 1.f, a.cpu_data(), b.cpu_data(), 0.f,
+          c.mutable_cpu_data());
+    }
+    const float blas_us = timer.MicroSeconds() / iterations;
+
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      cpu_gemm_packed(shape.M, shape.N, shape.K, packed.cpu_data(),
+          b.cpu_data(), shape.N, c.mutable_cpu_data(), shape.N);
+    }
+    const float native_us = timer.MicroSeconds() / iterations;
+
+    LOG(INFO) << shape.name << " (" << shape.M << " x " << shape.K << " x "
+              << shape.N << "): BLAS " << blas_us << " us, native "
+              << native_us << " us, " << blas_us / native_us << "x";
+  }
+  return 0;
+}
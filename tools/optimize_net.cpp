@@ -0,0 +1,42 @@
+// This is a script to rewrite a trained network for inference: BatchNorm
+// and Scale layers are folded into the preceding Convolution/InnerProduct
+// and Dropout/Split layers are removed. See OptimizeNetForInference.
+// Usage:
+//    optimize_net net_proto_file_in weights_in net_proto_file_out weights_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/optimize_net.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: optimize_net net_proto_file_in weights_in "
+        << "net_proto_file_out weights_out";
+    return 1;
+  }
+
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(string(argv[1]), TEST);
+  net.CopyTrainedLayersFrom(string(argv[2]));
+  NetParameter trained_param;
+  net.ToProto(&trained_param, false);
+  NetParameter optimized_param;
+  OptimizeNetForInference(trained_param, &optimized_param);
+  LOG(INFO) << "Layers: " << trained_param.layer_size() << " -> "
+            << optimized_param.layer_size();
+
+  WriteProtoToBinaryFile(optimized_param, argv[4]);
+  LOG(INFO) << "Wrote optimized weights to " << argv[4];
+  for (int i = 0; i < optimized_param.layer_size(); ++i) {
+    optimized_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(optimized_param, argv[3]);
+  LOG(INFO) << "Wrote optimized net to " << argv[3];
+  return 0;
+}